@@ -1,9 +1,14 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <getopt.h>
 #include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <ck_pr.h>
@@ -11,57 +16,212 @@
 #include <pf_hw_timer.h>
 
 #include "bench.h"
+#include "ebr.h"
+#include "he.h"
+#include "lat.h"
 #include "lf.h"
+#include "pmu.h"
+#include "pool.h"
+#include "so.h"
+#include "topo.h"
+#include "tsc.h"
+#include "wl.h"
 
 #define ARR_LEN(a) (sizeof(a) / sizeof(*(a)))
 
-#define TMAX (16)
-#define OPS_MAX (100000)
-static const uint64_t thr_nums[] = { 1, 2, 4, 8, TMAX };
-static const int64_t thr_ops_num[] = { OPS_MAX };
-static const double read_percents[] = { 0.9, 0.8, 0.5, 0.2, 0.0 };
+static const uint64_t thr_nums_default[] = { 1, 2, 4, 8, 16 };
+static const uint64_t thr_ops_num_default[] = { 100000 };
+static const uint64_t read_percents_default[] = { 90, 80, 50, 20, 0 };
+
+enum bench_format {
+	BENCH_FMT_TEXT,
+	BENCH_FMT_CSV,
+	BENCH_FMT_JSON,
+};
+
+struct bench_impl {
+	const char *name;
+	void *(*func)(void *);
+	/* Optional, runs untimed before the threads start (and before a mixed
+	 * workload's prefill). Non-zero fails the run.
+	 */
+	int (*setup)(thr_arg_t *args, uint64_t thrn);
+	void (*cleanup)(thr_arg_t *);
+	/* Optional, counts live and INV nodes right after the timed run */
+	void (*gauge)(thr_arg_t *, uint64_t *live, uint64_t *inv);
+	/* Zhang: deletes take a dummy node (from the pool when the thread's
+	 * ring has none to reuse)
+	 */
+	bool zhang;
+	/* Walks through unlinked nodes, which a hazard can't be validated on.
+	 * Eras are per slot too, so only ebr and qsbr can run it.
+	 */
+	bool epoch;
+	/* Deleted nodes go through the reclamation modes */
+	bool smr;
+	/* Keeps nodes in key order, checked by verify */
+	bool sorted;
+	/* The node lfhead_t is embedded in (lf.h) */
+	size_t node_size;
+};
+
+static const struct bench_impl impls[] = {
+	{ "lock", lock_trfunc, NULL, lock_cleanup, NULL, false, false, false,
+	  false, sizeof(lfhead_t) },
+	{ "harris", harris_trfunc, NULL, harris_cleanup, NULL, false, false,
+	  true, false, sizeof(lfhead_t) },
+	{ "harris_search", harris_search_trfunc, NULL, harris_cleanup, NULL,
+	  false, true, true, false, sizeof(lfhead_t) },
+	{ "michael", michael_trfunc, NULL, michael_cleanup, NULL, false, false,
+	  true, false, sizeof(lfhead_t) },
+	{ "zhang", zhang_trfunc, zhang_setup, zhang_cleanup, zhang_gauge, true,
+	  true, true, false, sizeof(struct zhang_node) },
+	{ "zhang_nodup", zhang_nodup_trfunc, zhang_setup, zhang_cleanup,
+	  zhang_gauge, true, true, true, false, sizeof(struct zhang_node) },
+	{ "zhang_wf", zhang_wf_trfunc, zhang_wf_setup, zhang_wf_cleanup,
+	  zhang_gauge, true, true, true, false, sizeof(struct zhang_node) },
+	{ "harris_sorted", harris_sorted_trfunc, NULL, harris_cleanup, NULL,
+	  false, false, true, true, sizeof(struct lfkey) },
+	{ "michael_sorted", michael_sorted_trfunc, NULL, michael_cleanup, NULL,
+	  false, false, true, true, sizeof(struct lfkey) },
+	{ "so", so_trfunc, so_setup, so_cleanup, NULL, false, false, true,
+	  true, sizeof(struct lfkey) },
+	{ "skiplist", sl_trfunc, sl_setup, sl_cleanup, NULL, false, false,
+	  true, true, sizeof(struct sl_node) },
+	{ "dll", dll_trfunc, NULL, dll_cleanup, NULL, false, false, true,
+	  false, sizeof(struct dll_node) },
+};
 
-// #define TMAX (2)
-// #define OPS_MAX (10000)
-// static const uint64_t thr_nums[] = { TMAX };
-// static const int64_t thr_ops_num[] = { OPS_MAX };
-// static const double read_percents[] = { 0.0 };
+struct bench_opts {
+	const struct bench_impl *impls[ARR_LEN(impls)];
+	size_t impl_num;
+	uint64_t *thr_nums;
+	size_t thr_num_len;
+	uint64_t *ops_nums;
+	size_t ops_num_len;
+	uint64_t *read_pers;
+	size_t read_per_len;
+	uint64_t reps;
+	enum bench_format format;
+	/* Mixed workload instead of the phases */
+	bool mix;
+	/* Back the node pool with 2 MB pages */
+	bool huge;
+	/* INV nodes Zhang's janitor unlinks per pass, 0 for none */
+	uint64_t compact;
+	/* Hardware counters around the timed region (pmu.h) */
+	bool perf;
+	/* Where threads run and where their nodes live (topo.h) */
+	struct topo_pin_cfg pin;
+	enum topo_mem mem;
+	/* Contention managers to compare (cm.h), each runs every config */
+	struct cm_cfg *cms;
+	size_t cm_num;
+	struct wl_cfg wl;
+};
+
+/* One line of output */
+struct bench_result {
+	const struct bench_impl *impl;
+	uint64_t rep;
+	uint64_t thrn;
+	int64_t total_ops;
+	double perins;
+	double perdel;
+	double perread;
+	struct timespec elapsed;
+	double ops_per_us;
+	uint64_t reclaimed;
+	uint64_t pending;
+	/* Slabs the node pool carved per op out of arenas mapped up front, so
+	 * not allocator calls
+	 */
+	double slabs_per_op;
+	/* Gauge of the list the run left behind, 0 without one */
+	uint64_t live;
+	uint64_t inv;
+	bool verified;
+	/* "phases" or the key distribution */
+	char workload[32];
+	uint64_t keys;
+	uint64_t seed;
+	enum topo_pin pin;
+	enum topo_mem mem;
+	char cm[32];
+	/* All threads merged */
+	const lat_tls_t *lat;
+	/* Hot path events per op, all 0 without BENCH_COUNTERS */
+	double events[CTR_NUM];
+	/* Hardware events per op when -P is given, -1 if unavailable */
+	bool perf;
+	double pmu[PMU_EVENT_NUM];
+};
 
 static lfhead_t head;
 static lfhead_t head_ret;
 
-static pthread_t tids[TMAX];
-static thr_arg_t targs[TMAX];
-static hp_tls_t hps[TMAX];
+/* Sized from the options in bench_alloc() */
+static uint64_t thr_max;
+static uint64_t ops_max;
+static pthread_t *tids;
+static thr_arg_t *targs;
+static hp_tls_t *hps;
+static hp_domain_t hp_dom;
+static ebr_tls_t *ebrs;
+static ebr_domain_t ebr_dom;
+static he_tls_t *hes;
+static he_domain_t he_dom;
+static enum smr_mode smr_mode = SMR_EBR;
 
-static lfhead_t nodes[TMAX][OPS_MAX];
-static lfhead_t dummies[TMAX][OPS_MAX];
+static lat_tls_t *lats;
+static lat_tls_t *lat_sum;
+static ctr_tls_t *ctrs;
+static struct topo topo;
+/* Where thread t runs, the same for every run */
+static struct topo_slot *slots;
+/* The list's thread function, run_threads starts bench_thread instead */
+static void *(*thread_func)(void *);
+static struct wl wl;
+/* Per thread generated ops, and the prefill inserts split between them */
+static struct wl_op *wl_ops;
+static struct wl_op *wl_pre;
+/* Phase nodes, ops_max per thread, and the mixed workload's key nodes.
+ * Slots are stride_max bytes, the biggest node of the impls given; each run
+ * packs its own nodes at the start of them (fill_args).
+ */
+static char *node_mem;
+static char *wl_mem;
+static size_t stride_max;
+static pool_tls_t *pools;
+static pool_domain_t pool_dom;
+static struct so_set so_set;
+static uint64_t results_printed;
+/* Runs that failed verify, the exit status is 1 if there are any */
+static uint64_t results_failed;
 
 static void reset_args(void)
 {
-	for (int i = 0; i < TMAX; ++i) {
+	for (uint64_t i = 0; i < thr_max; ++i) {
 		head.next = &head;
 		head_ret.next_ret = &head_ret;
-		targs[i].hp_tls = &hps[i];
+		targs[i].hp_tls = NULL;
+		targs[i].ebr_tls = NULL;
+		targs[i].he_tls = NULL;
 		targs[i].read_ops = 0;
 
 		targs[i].nodes = NULL;
 		targs[i].node_num = 0;
-
-		hp_clear(&hps[i]);
 	}
 }
 
-static bool verify_list_state(uint64_t thrn, uint64_t ins, uint64_t del, bool is_zhang)
+static bool verify_list_state(uint64_t thrn, uint64_t ins, uint64_t del,
+			      uint64_t hp_retired)
 {
 	uint64_t exist = 0;
-	uint64_t retired = 0;
+	uint64_t retired = hp_retired;
 
 	uint64_t exist_expect = del > ins ? 0 : ins - del;
 	uint64_t retired_expect = del > ins ? ins : del;
-	if (is_zhang) {
-		retired_expect *= 2;
-	}
 
 	exist_expect *= thrn;
 	retired_expect *= thrn;
@@ -81,28 +241,535 @@ static bool verify_list_state(uint64_t thrn, uint64_t ins, uint64_t del, bool is
 	return exist_expect == exist && retired_expect == retired;
 }
 
-static void fill_args(uint64_t thrn, int64_t opn, int64_t ropn)
+/* Every node retired through any reclamation domain */
+static void smr_stats(uint64_t *reclaimed, uint64_t *pending)
+{
+	uint64_t r, p;
+
+	hp_domain_stats(&hp_dom, reclaimed, pending);
+	ebr_domain_stats(&ebr_dom, &r, &p);
+	*reclaimed += r;
+	*pending += p;
+	he_domain_stats(&he_dom, &r, &p);
+	*reclaimed += r;
+	*pending += p;
+}
+
+/* Hazard eras keep theirs in front of the node (he.h) */
+static size_t node_pad(void)
+{
+	return smr_mode == SMR_HE ? sizeof(struct he_eras) : 0;
+}
+
+/* Node memory is shared by every impl's layout, so each run starts it
+ * zeroed. Keys for the sorted lists are set here too, since so rewrites
+ * them into split order. The phase nodes get an odd multiple of their
+ * index, which is unique but doesn't follow insert order.
+ */
+static void reset_nodes(const struct bench_impl *impl, uint64_t thrn)
+{
+	size_t pad = node_pad();
+
+	for (uint64_t t = 0; t < thrn; ++t) {
+		thr_arg_t *a = &targs[t];
+		char *n = (char *)a->nodes;
+
+		memset(n - pad, 0, a->node_stride * a->node_num);
+		for (uint64_t i = 0; impl->sorted && i < a->node_num; ++i) {
+			lfhead_t *node = (lfhead_t *)(void *)n;
+
+			to_lfkey(node)->key = (t * ops_max + i) *
+					      0x9E3779B97F4A7C15ULL;
+			n += a->node_stride;
+		}
+	}
+	if (!wl.nodes) {
+		return;
+	}
+	memset((char *)wl.nodes - pad, 0, wl.stride * wl.keys);
+	for (uint64_t k = 0; impl->sorted && k < wl.keys; ++k) {
+		to_lfkey(wl_node(&wl, k))->key = k;
+	}
+}
+
+static void fill_args(const struct bench_opts *o,
+		      const struct bench_impl *impl, uint64_t thrn, int64_t opn,
+		      int64_t ropn)
 {
+	size_t stride = impl->node_size + node_pad();
+
 	for (uint64_t t = 0; t < thrn; ++t) {
 		thr_arg_t *a = &targs[t];
 		a->tidx = t;
 		a->head = &head;
 		a->head_ret = &head_ret;
-		a->dummies = dummies[t];
-		a->hp_tls = &hps[t];
-		a->randseed = (unsigned int)time(NULL) + ((unsigned int)t * 30);
+		a->pool = pools ? pool_register(&pool_dom) : NULL;
+		a->compact = o->compact;
+		a->so = &so_set;
+		a->hp_tls = hp_register(&hp_dom);
+		a->ebr_tls = ebr_register(&ebr_dom);
+		a->he_tls = he_register(&he_dom);
+		a->smr_mode = smr_mode;
+		a->randseed = (unsigned int)o->wl.seed + ((unsigned int)t * 30);
+		a->lat = &lats[t];
+		lat_reset(a->lat);
+		a->ctr = &ctrs[t];
 		a->read_ops = ropn;
-		a->nodes = nodes[t];
+		a->nodes = (lfhead_t *)(void *)(node_mem + node_pad() +
+						stride_max * ops_max * t);
 		a->node_num = (uint64_t)opn;
+		a->node_stride = stride;
+		a->wl = o->mix ? &wl : NULL;
+		a->wl_ops = NULL;
+		a->wl_op_num = 0;
+		a->wl_errors = 0;
+	}
+	if (o->mix) {
+		wl.nodes = (lfhead_t *)(void *)(wl_mem + node_pad());
+		wl.stride = stride;
+	}
+}
+
+/* Points the thread's counters at its record before the list runs */
+static void *bench_thread(void *varg)
+{
+	ctr_bind(((thr_arg_t *)varg)->ctr);
+	return thread_func(varg);
+}
+
+/* Threads that did start are joined before a failure is returned */
+static int run_threads(const struct bench_impl *impl, uint64_t thrn)
+{
+	pthread_attr_t attr;
+	uint64_t started;
+	int err = 0;
+
+	thread_func = impl->func;
+	for (started = 0; started < thrn; ++started) {
+		pthread_attr_init(&attr);
+		err = topo_attr(&topo, &slots[started], &attr);
+		if (err != 0) {
+			printf("Failed to pin thread %lu: %s\n", started,
+			       strerror(err));
+		} else {
+			err = pthread_create(&tids[started], &attr,
+					     bench_thread, &targs[started]);
+			if (err != 0) {
+				printf("Failed to start thread %lu: %s\n",
+				       started, strerror(err));
+			}
+		}
+		pthread_attr_destroy(&attr);
+		if (err != 0) {
+			break;
+		}
+	}
+	for (uint64_t t = 0; t < started; ++t) {
+		pthread_join(tids[t], NULL);
+	}
+	return err;
+}
+
+/* Fills the list with every other key and generates the timed ops. The
+ * prefill runs through the list's own insert, untimed.
+ */
+static int wl_setup(const struct bench_opts *o,
+		     const struct bench_impl *impl, uint64_t thrn,
+		     int64_t opn, uint64_t read_per)
+{
+	size_t pre = 0;
+
+	memset(wl.state, 0, sizeof(*wl.state) * wl.keys);
+	wl.direct_free = !impl->smr;
+	wl.bad_reclaims = 0;
+	for (uint64_t t = 0; t < thrn; ++t) {
+		thr_arg_t *a = &targs[t];
+
+		a->wl = &wl;
+		a->wl_ops = &wl_pre[pre];
+		a->wl_op_num = wl_gen_prefill(&o->wl, t, thrn, &wl_pre[pre]);
+		pre += a->wl_op_num;
+	}
+	if (run_threads(impl, thrn) != 0) {
+		return -1;
+	}
+	for (uint64_t t = 0; t < thrn; ++t) {
+		thr_arg_t *a = &targs[t];
+
+		wl_gen(&o->wl, t, read_per, &wl_ops[t * ops_max], (size_t)opn);
+		a->wl_ops = &wl_ops[t * ops_max];
+		a->wl_op_num = (size_t)opn;
+		lat_reset(a->lat);
+	}
+	return 0;
+}
+
+/* Every IN key is linked and nothing else is */
+static bool wl_verify(uint64_t thrn)
+{
+	uint64_t exist = 0, expect = 0;
+	lfhead_t *curr = ck_pr_load_ptr(&head.next);
+
+	while (curr != &head) {
+		curr = ck_pr_load_ptr(&curr->next);
+		++exist;
+	}
+	for (uint64_t k = 0; k < wl.keys; ++k) {
+		expect += wl.state[k] == WL_IN;
+	}
+	for (uint64_t t = 0; t < thrn; ++t) {
+		if (targs[t].wl_errors) {
+			return false;
+		}
+	}
+	return exist == expect;
+}
+
+/* Once the domains are drained every deleted key was reclaimed, and each
+ * exactly once: a key retired twice is reclaimed while it isn't RETIRED.
+ */
+static bool wl_verify_reclaimed(void)
+{
+	for (uint64_t k = 0; k < wl.keys; ++k) {
+		if (wl.state[k] == WL_RETIRED) {
+			return false;
+		}
+	}
+	return wl.bad_reclaims == 0;
+}
+
+/* Keys strictly ascend, so there are no duplicates either */
+static bool list_sorted(void)
+{
+	lfhead_t *prev = ck_pr_load_ptr(&head.next);
+	lfhead_t *curr;
+
+	if (prev == &head) {
+		return true;
+	}
+	for (curr = ck_pr_load_ptr(&prev->next); curr != &head;
+	     curr = ck_pr_load_ptr(&curr->next)) {
+		if (LF_KEY_CMP(to_lfkey(prev)->key,
+			       to_lfkey(curr)->key) >= 0) {
+			return false;
+		}
+		prev = curr;
+	}
+	return true;
+}
+
+static const double lat_quantiles[] = { 0.5, 0.99, 0.999 };
+static const char *const lat_quantile_names[] = { "p50", "p99", "p999" };
+
+/* Cycles to ns when the TSC was calibrated, raw cycles otherwise */
+static uint64_t lat_convert(uint64_t cycles)
+{
+	uint64_t hz = tsc_freq_hz();
+
+	return hz ? (uint64_t)((double)cycles * 1e9 / (double)hz) : cycles;
+}
+
+static const char *lat_unit(void)
+{
+	return tsc_freq_hz() ? "ns" : "cycles";
+}
+
+static void lat_print_text(const lat_tls_t *l)
+{
+	for (int op = 0; op < LAT_OP_NUM; ++op) {
+		const struct lat_hist *h = &l->ops[op];
+
+		if (h->num == 0) {
+			continue;
+		}
+		printf("    %-6s (%s): ", lat_op_name((enum lat_op)op),
+		       lat_unit());
+		for (size_t q = 0; q < ARR_LEN(lat_quantiles); ++q) {
+			printf("%s: %8lu; ", lat_quantile_names[q],
+			       lat_convert(lat_quantile(h, lat_quantiles[q])));
+		}
+		printf("max: %8lu\n", lat_convert(h->max));
 	}
 }
 
-static void execute(uint64_t thrn, int64_t opn, int64_t ropn,
-		    void *(*func)(void *), void (*cleanup_func)(thr_arg_t *))
+static void result_print_text(const struct bench_result *r)
 {
-	struct pf_hw_timer timer;
+	struct timespec elapsed = r->elapsed;
 	char buff[128];
+
+	pf_timer_pretty_time(&elapsed, PF_HW_TIMER_MS, 2, buff, 128);
+	if (!r->verified) {
+		printf("fail!\n");
+	}
+	printf("Impl: %-7s; ", r->impl->name);
+	printf("Threads:  %2lu; ", r->thrn);
+	printf("Insert:  %3.0f%%; ", r->perins);
+	printf("Delete:  %3.0f%%; ", r->perdel);
+	printf("Read:  %3.0f%%; ", r->perread);
+	printf("Ops/µs:  %6.3f; ", r->ops_per_us);
+	printf("Reclaimed:  %7lu; ", r->reclaimed);
+	printf("Pending:  %5lu; ", r->pending);
+	printf("Slabs/op:  %.4f; ", r->slabs_per_op);
+	printf("CM:  %s; ", r->cm);
+	if (r->impl->gauge) {
+		printf("Live:  %6lu; INV:  %6lu; ", r->live, r->inv);
+	}
+	printf("Elapsed Time:  %s\n", buff);
+#if BENCH_LATENCY
+	lat_print_text(r->lat);
+#endif
+	if (r->perf) {
+		printf("    hw per op: ");
+		for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+			printf("%s: ", pmu_event_name((enum pmu_event)e));
+			if (r->pmu[e] < 0) {
+				printf("n/a");
+			} else {
+				printf("%.2f", r->pmu[e]);
+			}
+			printf("%s", e + 1 < PMU_EVENT_NUM ? "; " : "\n");
+		}
+	}
+#if BENCH_COUNTERS
+	printf("    per op: ");
+	for (int e = 0; e < CTR_NUM; ++e) {
+		printf("%s: %.3f%s", ctr_event_name((enum ctr_event)e),
+		       r->events[e], e + 1 < CTR_NUM ? "; " : "\n");
+	}
+#endif
+}
+
+static uint64_t timespec_ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000 + (uint64_t)ts->tv_nsec;
+}
+
+static void result_print_csv(const struct bench_result *r)
+{
+	if (results_printed == 0) {
+		printf("impl,smr,rep,threads,ops_per_thread,insert_pct,"
+		       "delete_pct,read_pct,elapsed_ns,ops_per_us,reclaimed,"
+		       "pending,slabs_per_op,live,inv,verified,clock,tsc_hz,"
+		       "workload,keys,seed,pin,mem,cpus,packages,numa_nodes,"
+		       "cm");
+#if BENCH_LATENCY
+		printf(",lat_unit");
+		for (int op = 0; op < LAT_OP_NUM; ++op) {
+			for (size_t q = 0; q < ARR_LEN(lat_quantiles); ++q) {
+				printf(",%s_%s", lat_op_name((enum lat_op)op),
+				       lat_quantile_names[q]);
+			}
+			printf(",%s_max", lat_op_name((enum lat_op)op));
+		}
+#endif
+		if (r->perf) {
+			for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+				printf(",%s_per_op",
+				       pmu_event_name((enum pmu_event)e));
+			}
+		}
+#if BENCH_COUNTERS
+		for (int e = 0; e < CTR_NUM; ++e) {
+			printf(",%s_per_op", ctr_event_name((enum ctr_event)e));
+		}
+#endif
+		printf("\n");
+	}
+	printf("%s,%s,%lu,%lu,%ld,%.2f,%.2f,%.2f,%lu,%.3f,%lu,%lu,%.6f,%lu,"
+	       "%lu,%d,%s,%lu,%s,%lu,%lu,%s,%s,%lu,%lu,%lu,%s",
+	       r->impl->name, smr_mode_name(smr_mode), r->rep, r->thrn,
+	       r->total_ops, r->perins, r->perdel, r->perread,
+	       timespec_ns(&r->elapsed), r->ops_per_us, r->reclaimed,
+	       r->pending, r->slabs_per_op, r->live, r->inv, r->verified,
+	       tsc_clock_name(), tsc_freq_hz(), r->workload, r->keys, r->seed,
+	       topo_pin_name(r->pin), topo_mem_name(r->mem), topo.cpu_num,
+	       topo.package_num, topo.node_num, r->cm);
+#if BENCH_LATENCY
+	printf(",%s", lat_unit());
+	for (int op = 0; op < LAT_OP_NUM; ++op) {
+		const struct lat_hist *h = &r->lat->ops[op];
+
+		for (size_t q = 0; q < ARR_LEN(lat_quantiles); ++q) {
+			printf(",%lu",
+			       lat_convert(lat_quantile(h, lat_quantiles[q])));
+		}
+		printf(",%lu", lat_convert(h->max));
+	}
+#endif
+	if (r->perf) {
+		/* Unavailable events are left empty */
+		for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+			if (r->pmu[e] < 0) {
+				printf(",");
+			} else {
+				printf(",%.4f", r->pmu[e]);
+			}
+		}
+	}
+#if BENCH_COUNTERS
+	for (int e = 0; e < CTR_NUM; ++e) {
+		printf(",%.4f", r->events[e]);
+	}
+#endif
+	printf("\n");
+}
+
+/* Runs are elements of one array, closed by output_end() */
+static void result_print_json(const struct bench_result *r)
+{
+	printf("%s\n  {", results_printed == 0 ? "[" : ",");
+	printf("\"impl\": \"%s\", \"smr\": \"%s\", \"rep\": %lu, ",
+	       r->impl->name, smr_mode_name(smr_mode), r->rep);
+	printf("\"threads\": %lu, \"ops_per_thread\": %ld, ", r->thrn,
+	       r->total_ops);
+	printf("\"insert_pct\": %.2f, \"delete_pct\": %.2f, "
+	       "\"read_pct\": %.2f, ",
+	       r->perins, r->perdel, r->perread);
+	printf("\"elapsed_ns\": %lu, \"ops_per_us\": %.3f, ",
+	       timespec_ns(&r->elapsed), r->ops_per_us);
+	printf("\"reclaimed\": %lu, \"pending\": %lu, "
+	       "\"slabs_per_op\": %.6f, \"live\": %lu, \"inv\": %lu, "
+	       "\"verified\": %s, ",
+	       r->reclaimed, r->pending, r->slabs_per_op, r->live, r->inv,
+	       r->verified ? "true" : "false");
+	printf("\"clock\": \"%s\", \"tsc_hz\": %lu, ", tsc_clock_name(),
+	       tsc_freq_hz());
+	printf("\"workload\": \"%s\", \"keys\": %lu, \"seed\": %lu, ",
+	       r->workload, r->keys, r->seed);
+	printf("\"pin\": \"%s\", \"mem\": \"%s\", \"cpus\": %lu, "
+	       "\"packages\": %lu, \"numa_nodes\": %lu, \"cm\": \"%s\"",
+	       topo_pin_name(r->pin), topo_mem_name(r->mem), topo.cpu_num,
+	       topo.package_num, topo.node_num, r->cm);
+#if BENCH_LATENCY
+	printf(", \"latency\": {\"unit\": \"%s\"", lat_unit());
+	for (int op = 0; op < LAT_OP_NUM; ++op) {
+		const struct lat_hist *h = &r->lat->ops[op];
+
+		printf(", \"%s\": {\"samples\": %lu",
+		       lat_op_name((enum lat_op)op), h->num);
+		for (size_t q = 0; q < ARR_LEN(lat_quantiles); ++q) {
+			printf(", \"%s\": %lu", lat_quantile_names[q],
+			       lat_convert(lat_quantile(h, lat_quantiles[q])));
+		}
+		printf(", \"max\": %lu}", lat_convert(h->max));
+	}
+	printf("}");
+#endif
+	if (r->perf) {
+		printf(", \"hw_per_op\": {");
+		for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+			printf("%s\"%s\": ", e ? ", " : "",
+			       pmu_event_name((enum pmu_event)e));
+			if (r->pmu[e] < 0) {
+				printf("null");
+			} else {
+				printf("%.4f", r->pmu[e]);
+			}
+		}
+		printf("}");
+	}
+#if BENCH_COUNTERS
+	printf(", \"per_op\": {");
+	for (int e = 0; e < CTR_NUM; ++e) {
+		printf("%s\"%s\": %.4f", e ? ", " : "",
+		       ctr_event_name((enum ctr_event)e), r->events[e]);
+	}
+	printf("}");
+#endif
+	printf("}");
+}
+
+static void result_print(enum bench_format format,
+			 const struct bench_result *r)
+{
+	switch (format) {
+	case BENCH_FMT_TEXT:
+		result_print_text(r);
+		break;
+	case BENCH_FMT_CSV:
+		result_print_csv(r);
+		break;
+	case BENCH_FMT_JSON:
+		result_print_json(r);
+		break;
+	default:
+		break;
+	}
+	++results_printed;
+	results_failed += !r->verified;
+	fflush(stdout);
+}
+
+static void output_begin(const struct bench_opts *o)
+{
+	char dist[32];
+
+	if (o->format == BENCH_FMT_TEXT) {
+		if (o->mix) {
+			wl_dist_name(&o->wl, dist, sizeof(dist));
+			printf("Workload: %s over %lu keys; Seed: %lu\n", dist,
+			       o->wl.keys, o->wl.seed);
+		} else {
+			printf("Workload: phases; Seed: %lu\n", o->wl.seed);
+		}
+		if (pools) {
+			printf("Pool: %s pages\n",
+			       pool_pages_name(pool_dom.pages));
+		}
+		printf("Topology: %lu CPUs, %lu packages, %lu NUMA nodes\n",
+		       topo.cpu_num, topo.package_num, topo.node_num);
+		printf("Pin: %s", topo_pin_name(o->pin.pin));
+		if (o->pin.pin != TOPO_PIN_NONE) {
+			/* Thread t's CPU, or its node as nN */
+			printf(" (");
+			for (uint64_t t = 0; t < thr_max; ++t) {
+				printf(slots[t].cpu >= 0 ? "%s%d" : "%sn%d",
+				       t ? "," : "",
+				       slots[t].cpu >= 0 ? slots[t].cpu :
+							   slots[t].node);
+			}
+			printf(")");
+		}
+		printf("; Memory: %s\n", topo_mem_name(o->mem));
+		if (tsc_freq_hz()) {
+			printf("Clock: tsc (%.2f MHz)\n",
+			       (double)tsc_freq_hz() / 1e6);
+		} else {
+			printf("Clock: monotonic (TSC not invariant)\n");
+		}
+	}
+}
+
+static void output_end(enum bench_format format)
+{
+	if (format == BENCH_FMT_JSON) {
+		printf("%s]\n", results_printed == 0 ? "[" : "\n");
+	}
+}
+
+static void events_per_op(double *events, uint64_t thrn, double ops)
+{
+	for (int e = 0; e < CTR_NUM; ++e) {
+		uint64_t sum = 0;
+
+		for (uint64_t t = 0; t < thrn; ++t) {
+			sum += ctrs[t].ev[e];
+		}
+		events[e] = (double)sum / ops;
+	}
+}
+
+static int execute(const struct bench_opts *o, const struct bench_impl *impl,
+		    uint64_t rep, uint64_t thrn, int64_t opn, uint64_t read_per)
+{
+	struct tsc_timer timer;
+	struct bench_result r;
 	int64_t total_ops = opn;
+	int64_t ropn = (int64_t)((double)read_per / 100 * (double)opn);
+	uint64_t reclaimed_start, reclaimed, pending;
+	uint64_t slabs_start;
+	struct pmu pmu;
+	int err;
 
 	opn = opn - ropn;
 	while (opn + ropn > total_ops) {
@@ -112,77 +779,738 @@ static void execute(uint64_t thrn, int64_t opn, int64_t ropn,
 		++opn;
 	}
 	reset_args();
-	fill_args(thrn, opn, ropn);
+	fill_args(o, impl, thrn, opn, ropn);
+	reset_nodes(impl, thrn);
+	if (impl->setup && impl->setup(targs, thrn) != 0) {
+		printf("Failed to set up %s\n", impl->name);
+		return -1;
+	}
+	if (o->mix && wl_setup(o, impl, thrn, total_ops, read_per) != 0) {
+		return -1;
+	}
+	smr_stats(&reclaimed_start, &pending);
+	slabs_start = pool_domain_slabs(&pool_dom);
+	/* The prefill counted too */
+	memset(ctrs, 0, sizeof(*ctrs) * thrn);
+	/* Opened here so only the timed threads inherit them */
+	if (o->perf) {
+		pmu_open(&pmu);
+		pmu_start(&pmu);
+	}
 
-	pf_hw_timer_start(&timer);
+	tsc_timer_start(&timer);
+	err = run_threads(impl, thrn);
+	tsc_timer_end(&timer);
+	if (err != 0) {
+		if (o->perf) {
+			pmu_close(&pmu);
+		}
+		return -1;
+	}
+	r.perf = o->perf;
+	if (o->perf) {
+		pmu_stop(&pmu, r.pmu);
+		pmu_close(&pmu);
+		for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+			if (r.pmu[e] >= 0) {
+				r.pmu[e] /= (double)total_ops * (double)thrn;
+			}
+		}
+	}
+	r.slabs_per_op =
+		(double)(pool_domain_slabs(&pool_dom) - slabs_start) /
+		((double)total_ops * (double)thrn);
+	events_per_op(r.events, thrn, (double)total_ops * (double)thrn);
+	r.live = 0;
+	r.inv = 0;
+	if (impl->gauge) {
+		impl->gauge(&targs[0], &r.live, &r.inv);
+	}
+	/* Cleanup may retire nodes, so it runs while records are registered.
+	 * Stats are taken before unregistering, which collects what is left.
+	 */
+	impl->cleanup(&targs[0]);
+	smr_stats(&reclaimed, &pending);
+	reclaimed -= reclaimed_start;
 	for (uint64_t t = 0; t < thrn; ++t) {
-		pthread_create(&tids[t], NULL, func, &targs[t]);
+		hp_unregister(targs[t].hp_tls);
+		ebr_unregister(targs[t].ebr_tls);
+		he_unregister(targs[t].he_tls);
+		if (targs[t].pool) {
+			pool_unregister(targs[t].pool);
+		}
 	}
+	lat_reset(lat_sum);
 	for (uint64_t t = 0; t < thrn; ++t) {
-		pthread_join(tids[t], NULL);
+		lat_merge(lat_sum, &lats[t]);
 	}
-	pf_hw_timer_end(&timer, PF_TSC_FREQ_HZ_INTEL_12700K);
-	cleanup_func(&targs[0]);
-	if (!verify_list_state(thrn, (uint64_t)opn, (uint64_t)opn, func == zhang_trfunc)) {
-		printf("fail!\n");
+	if (o->mix) {
+		r.verified = wl_verify(thrn);
+	} else {
+		r.verified = verify_list_state(thrn, (uint64_t)opn,
+					       (uint64_t)opn,
+					       reclaimed + pending);
+	}
+	if (impl->sorted) {
+		r.verified = r.verified && list_sorted();
+	}
+	/* Nothing is registered anymore, so the leftovers are safe to drop */
+	hp_domain_drain(&hp_dom);
+	ebr_domain_drain(&ebr_dom);
+	he_domain_drain(&he_dom);
+	if (o->mix && impl->smr) {
+		r.verified = r.verified && wl_verify_reclaimed();
 	}
-	enum pf_hw_timer_units unit = PF_HW_TIMER_MS;
-	pf_timer_pretty_time(&timer.duration, unit, 2, buff, 128);
 
 	double totops = (double)total_ops;
 	double idops = (double)opn;
 	double rops = (double)ropn;
-	double perins = (idops * 50 / totops);
-	double perdel = perins;
-	double perread = (rops * 100 / totops);
 	double sec = (double)timer.duration.tv_sec;
 	double ns = (double)timer.duration.tv_nsec;
 	double us = (sec * 1000000) + (ns / 1000);
 	double ops = totops * (double)thrn;
-	printf("Threads:  %2lu; ", thrn);
-	printf("Insert:  %3.0f%%; ", perins);
-	printf("Delete:  %3.0f%%; ", perdel);
-	printf("Read:  %3.0f%%; ", perread);
-	printf("Ops/µs:  %6.3f; ", ops / us);
-	printf("Elapsed Time:  %s\n", buff);
+
+	r.impl = impl;
+	r.rep = rep;
+	r.thrn = thrn;
+	r.total_ops = total_ops;
+	r.perins = (idops * 50 / totops);
+	r.perdel = r.perins;
+	r.perread = (rops * 100 / totops);
+	r.elapsed = timer.duration;
+	r.ops_per_us = ops / us;
+	r.reclaimed = reclaimed;
+	r.pending = pending;
+	r.lat = lat_sum;
+	if (o->mix) {
+		wl_dist_name(&o->wl, r.workload, sizeof(r.workload));
+		r.keys = o->wl.keys;
+	} else {
+		snprintf(r.workload, sizeof(r.workload), "phases");
+		r.keys = 0;
+	}
+	r.seed = o->wl.seed;
+	r.pin = o->pin.pin;
+	r.mem = o->mem;
+	cm_cfg_name(&cm_cfg, r.cm, sizeof(r.cm));
+	result_print(o->format, &r);
+	return 0;
 }
 
-int main(int argc, char *argv[])
+static void usage(const char *prog)
 {
-	size_t opidx = 0, opidx_end = ARR_LEN(thr_ops_num);
-	size_t ridx = 0, ridx_end = ARR_LEN(read_percents);
-	size_t tidx = 0, tidx_end = ARR_LEN(thr_nums);
-	void *(*func)(void *);
-	void (*cleanup_func)(thr_arg_t *);
-
-	if (argc > 1) {
-		if (strcmp(argv[1], "lock") == 0) {
-			func = lock_trfunc;
-			cleanup_func = lock_cleanup;
-		} else if (strcmp(argv[1], "zhang") == 0) {
-			func = zhang_trfunc;
-			cleanup_func = zhang_cleanup;
-		}else {
-			printf("Please specify a valid implementation: { lock }\n");
-			return 1;
+	printf("Usage: %s [options] [impl[,impl...]] [smr]\n", prog);
+	printf("  -i, --impl LIST     implementations { lock, harris, "
+	       "harris_search, michael, zhang, zhang_nodup, zhang_wf, "
+	       "harris_sorted, michael_sorted, so, skiplist, dll }\n");
+	printf("  -s, --smr MODE      reclamation mode "
+	       "{ hp, ebr, qsbr, he } (ebr)\n");
+	printf("  -t, --threads LIST  thread counts (1,2,4,8,16)\n");
+	printf("  -n, --ops LIST      operations per thread (100000)\n");
+	printf("  -r, --reads LIST    read percentages (90,80,50,20,0)\n");
+	printf("  -R, --reps N        repetitions of every configuration "
+	       "(1)\n");
+	printf("  -f, --format FMT    output { text, csv, json } (text)\n");
+	printf("  -w, --workload W    phases, or a mixed workload over shared "
+	       "keys:\n");
+	printf("                      uniform, zipf[:theta], "
+	       "hot[:key_pct:op_pct] (phases)\n");
+	printf("  -k, --keys N        key space of the mixed workload "
+	       "(1024)\n");
+	printf("  -S, --seed N        seed for every random choice (time)\n");
+	printf("  -H, --huge          back the node pool with 2 MB pages\n");
+	printf("  -J, --janitor N     zhang: a thread unlinks up to N INV "
+	       "nodes per pass (0)\n");
+	printf("  -P, --perf          count cycles, instructions and "
+	       "cache/branch misses per op\n");
+	printf("  -p, --pin POLICY    thread placement "
+	       "{ none, compact, scatter, numa, list:CPUS } (none)\n");
+	printf("  -m, --mem POLICY    node memory "
+	       "{ default, local, interleave } (default)\n");
+	printf("  -C, --cm LIST       head CAS contention management "
+	       "{ none, backoff[:min:max] } (none)\n");
+	printf("  -h, --help          show this message\n");
+}
+
+/* Comma separated, every value within [min, max] */
+static int parse_list(const char *str, uint64_t min, uint64_t max,
+		      uint64_t **out, size_t *len)
+{
+	size_t n = 1;
+	const char *c;
+	uint64_t *vals;
+
+	for (c = str; *c; ++c) {
+		n += *c == ',';
+	}
+	vals = malloc(sizeof(*vals) * n);
+	if (!vals) {
+		return -1;
+	}
+	for (size_t i = 0; i < n; ++i) {
+		char *end;
+		unsigned long long v;
+
+		errno = 0;
+		v = strtoull(str, &end, 10);
+		if (errno || end == str || (*end && *end != ',') || v < min ||
+		    v > max) {
+			free(vals);
+			return -1;
+		}
+		vals[i] = (uint64_t)v;
+		str = end + 1;
+	}
+	free(*out);
+	*out = vals;
+	*len = n;
+	return 0;
+}
+
+static int parse_impls(const char *str, struct bench_opts *o)
+{
+	char *list = strdup(str);
+	char *save = NULL;
+	char *name;
+
+	if (!list) {
+		return -1;
+	}
+	o->impl_num = 0;
+	for (name = strtok_r(list, ",", &save); name;
+	     name = strtok_r(NULL, ",", &save)) {
+		size_t i;
+
+		for (i = 0; i < ARR_LEN(impls); ++i) {
+			if (strcmp(name, impls[i].name) == 0) {
+				break;
+			}
+		}
+		if (i == ARR_LEN(impls) || o->impl_num == ARR_LEN(impls)) {
+			free(list);
+			return -1;
+		}
+		o->impls[o->impl_num++] = &impls[i];
+	}
+	free(list);
+	return o->impl_num > 0 ? 0 : -1;
+}
+
+static int parse_cms(const char *str, struct bench_opts *o)
+{
+	char *list = strdup(str);
+	char *save = NULL;
+	char *name;
+	size_t n = 1;
+
+	for (const char *c = str; *c; ++c) {
+		n += *c == ',';
+	}
+	free(o->cms);
+	o->cms = calloc(n, sizeof(*o->cms));
+	if (!list || !o->cms) {
+		free(list);
+		return -1;
+	}
+	o->cm_num = 0;
+	for (name = strtok_r(list, ",", &save); name;
+	     name = strtok_r(NULL, ",", &save)) {
+		if (cm_cfg_parse(name, &o->cms[o->cm_num++]) != 0) {
+			free(list);
+			return -1;
 		}
+	}
+	free(list);
+	return o->cm_num > 0 ? 0 : -1;
+}
+
+static int parse_format(const char *str, enum bench_format *format)
+{
+	if (strcmp(str, "text") == 0) {
+		*format = BENCH_FMT_TEXT;
+	} else if (strcmp(str, "csv") == 0) {
+		*format = BENCH_FMT_CSV;
+	} else if (strcmp(str, "json") == 0) {
+		*format = BENCH_FMT_JSON;
 	} else {
-		func = lock_trfunc;
-		cleanup_func = lock_cleanup;
+		return -1;
+	}
+	return 0;
+}
+
+static int list_dup(const uint64_t *src, size_t len, uint64_t **out,
+		    size_t *out_len)
+{
+	*out = malloc(sizeof(*src) * len);
+	if (!*out) {
+		return -1;
+	}
+	memcpy(*out, src, sizeof(*src) * len);
+	*out_len = len;
+	return 0;
+}
+
+/* Returns 1 when the program should exit successfully (--help) */
+static int parse_opts(int argc, char *argv[], struct bench_opts *o)
+{
+	static const struct option long_opts[] = {
+		{ "impl", required_argument, NULL, 'i' },
+		{ "smr", required_argument, NULL, 's' },
+		{ "threads", required_argument, NULL, 't' },
+		{ "ops", required_argument, NULL, 'n' },
+		{ "reads", required_argument, NULL, 'r' },
+		{ "reps", required_argument, NULL, 'R' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "workload", required_argument, NULL, 'w' },
+		{ "keys", required_argument, NULL, 'k' },
+		{ "seed", required_argument, NULL, 'S' },
+		{ "huge", no_argument, NULL, 'H' },
+		{ "janitor", required_argument, NULL, 'J' },
+		{ "perf", no_argument, NULL, 'P' },
+		{ "pin", required_argument, NULL, 'p' },
+		{ "mem", required_argument, NULL, 'm' },
+		{ "cm", required_argument, NULL, 'C' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 },
+	};
+	uint64_t *val = NULL;
+	size_t val_len;
+	int c;
+
+	memset(o, 0, sizeof(*o));
+	o->impls[0] = &impls[0];
+	o->impl_num = 1;
+	o->reps = 1;
+	o->format = BENCH_FMT_TEXT;
+	o->wl.keys = 1024;
+	o->wl.seed = (uint64_t)time(NULL);
+	if (list_dup(thr_nums_default, ARR_LEN(thr_nums_default), &o->thr_nums,
+		     &o->thr_num_len) ||
+	    list_dup(thr_ops_num_default, ARR_LEN(thr_ops_num_default),
+		     &o->ops_nums, &o->ops_num_len) ||
+	    list_dup(read_percents_default, ARR_LEN(read_percents_default),
+		     &o->read_pers, &o->read_per_len) ||
+	    parse_cms("none", o) != 0) {
+		printf("Out of memory\n");
+		return -1;
+	}
+
+	while ((c = getopt_long(argc, argv, "i:s:t:n:r:R:f:w:k:S:HJ:Pp:m:C:h",
+				long_opts, NULL)) != -1) {
+		switch (c) {
+		case 'i':
+			if (parse_impls(optarg, o) != 0) {
+				printf("Please specify valid implementations: "
+				       "{ lock, harris, harris_search, "
+				       "michael, zhang, zhang_nodup, zhang_wf, "
+				       "harris_sorted, michael_sorted, so, "
+				       "skiplist, dll }\n");
+				return -1;
+			}
+			break;
+		case 's':
+			if (smr_mode_parse(optarg, &smr_mode) != 0) {
+				printf("Please specify a valid reclamation "
+				       "mode: { hp, ebr, qsbr, he }\n");
+				return -1;
+			}
+			break;
+		case 't':
+			if (parse_list(optarg, 1, UINT32_MAX, &o->thr_nums,
+				       &o->thr_num_len) != 0) {
+				printf("Invalid thread counts: %s\n", optarg);
+				return -1;
+			}
+			break;
+		case 'n':
+			if (parse_list(optarg, 1, INT64_MAX, &o->ops_nums,
+				       &o->ops_num_len) != 0) {
+				printf("Invalid operation counts: %s\n",
+				       optarg);
+				return -1;
+			}
+			break;
+		case 'r':
+			if (parse_list(optarg, 0, 100, &o->read_pers,
+				       &o->read_per_len) != 0) {
+				printf("Invalid read percentages: %s\n",
+				       optarg);
+				return -1;
+			}
+			break;
+		case 'R':
+			if (parse_list(optarg, 1, UINT32_MAX, &val,
+				       &val_len) != 0 ||
+			    val_len != 1) {
+				printf("Invalid repetitions: %s\n", optarg);
+				free(val);
+				return -1;
+			}
+			o->reps = val[0];
+			free(val);
+			val = NULL;
+			break;
+		case 'w':
+			if (strcmp(optarg, "phases") == 0) {
+				o->mix = false;
+			} else if (wl_dist_parse(optarg, &o->wl) == 0) {
+				o->mix = true;
+			} else {
+				printf("Please specify a valid workload: "
+				       "{ phases, uniform, zipf[:theta], "
+				       "hot[:key_pct:op_pct] }\n");
+				return -1;
+			}
+			break;
+		case 'k':
+		case 'S':
+			if (parse_list(optarg, c == 'k' ? 1 : 0,
+				       c == 'k' ? UINT32_MAX : UINT64_MAX, &val,
+				       &val_len) != 0 ||
+			    val_len != 1) {
+				printf("Invalid %s: %s\n",
+				       c == 'k' ? "key count" : "seed", optarg);
+				free(val);
+				return -1;
+			}
+			if (c == 'k') {
+				o->wl.keys = val[0];
+			} else {
+				o->wl.seed = val[0];
+			}
+			free(val);
+			val = NULL;
+			break;
+		case 'H':
+			o->huge = true;
+			break;
+		case 'P':
+			o->perf = true;
+			break;
+		case 'p':
+			if (topo_pin_parse(optarg, &o->pin) != 0) {
+				printf("Please specify a valid pinning: "
+				       "{ none, compact, scatter, numa, "
+				       "list:CPUS }\n");
+				return -1;
+			}
+			break;
+		case 'm':
+			if (topo_mem_parse(optarg, &o->mem) != 0) {
+				printf("Please specify a valid memory "
+				       "placement: "
+				       "{ default, local, interleave }\n");
+				return -1;
+			}
+			break;
+		case 'C':
+			if (parse_cms(optarg, o) != 0) {
+				printf("Please specify valid contention "
+				       "management: "
+				       "{ none, backoff[:min:max] }\n");
+				return -1;
+			}
+			break;
+		case 'J':
+			if (parse_list(optarg, 0, UINT64_MAX, &val,
+				       &val_len) != 0 ||
+			    val_len != 1) {
+				printf("Invalid janitor batch: %s\n", optarg);
+				free(val);
+				return -1;
+			}
+			o->compact = val[0];
+			free(val);
+			val = NULL;
+			break;
+		case 'f':
+			if (parse_format(optarg, &o->format) != 0) {
+				printf("Please specify a valid format: "
+				       "{ text, csv, json }\n");
+				return -1;
+			}
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 1;
+		default:
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	/* Positional form kept from before the options existed */
+	if (optind < argc && parse_impls(argv[optind++], o) != 0) {
+		printf("Please specify valid implementations: "
+		       "{ lock, harris, harris_search, michael, zhang, "
+		       "zhang_nodup, zhang_wf, harris_sorted, michael_sorted, "
+		       "so, skiplist, dll }\n");
+		return -1;
+	}
+	if (optind < argc && smr_mode_parse(argv[optind++], &smr_mode) != 0) {
+		printf("Please specify a valid reclamation mode: "
+		       "{ hp, ebr, qsbr, he }\n");
+		return -1;
+	}
+	if (optind < argc) {
+		usage(argv[0]);
+		return -1;
 	}
+	return 0;
+}
+
+static uint64_t list_max(const uint64_t *vals, size_t len)
+{
+	uint64_t max = 0;
+
+	for (size_t i = 0; i < len; ++i) {
+		max = vals[i] > max ? vals[i] : max;
+	}
+	return max;
+}
 
-	for (opidx = 0; opidx < opidx_end; ++opidx) {
-		for (ridx = 0; ridx < ridx_end; ++ridx) {
-			for (tidx = 0; tidx < tidx_end; ++tidx) {
-				int64_t opn = thr_ops_num[opidx];
-				double rper = read_percents[ridx];
-				uint64_t thrn = thr_nums[tidx];
+/* Pool nodes (Zhang's dummies) go back to their owner's freelist.
+ * Reclaimed keys of the mixed workload become insertable again, the phase
+ * workload's nodes are ignored by wl_reclaim.
+ */
+static void bench_reclaim(lfhead_t *node, void *ctx)
+{
+	(void)ctx;
+	if (pool_owns(&pool_dom, node)) {
+		pool_put(&pool_dom, node);
+		return;
+	}
+	wl_reclaim(node, &wl);
+}
 
-				int64_t ropn = (int64_t)(rper * (double)opn);
-				execute(thrn, opn, ropn, func, cleanup_func);
+/* One probe up front, so a host without perf events runs without the
+ * columns instead of printing them empty for every run.
+ */
+static bool perf_usable(void)
+{
+	struct pmu p;
+	int n = pmu_open(&p);
+
+	pmu_close(&p);
+	if (n == 0) {
+		fprintf(stderr, "perf events aren't available (see "
+				"/proc/sys/kernel/perf_event_paranoid), "
+				"running without -P\n");
+	}
+	return n > 0;
+}
+
+/* Thread t's phase nodes and pool arena (fill_args registers records in
+ * thread order) go to its node. Mixed workload keys are shared, so only
+ * interleaving moves them.
+ */
+static int bench_place(const struct bench_opts *o)
+{
+	size_t len = stride_max * ops_max;
+	int err = 0;
+
+	switch (o->mem) {
+	case TOPO_MEM_LOCAL:
+		for (uint64_t t = 0; t < thr_max; ++t) {
+			if (slots[t].node < 0) {
+				continue;
 			}
+			err |= topo_mem_place(&topo, node_mem + len * t, len,
+					      slots[t].node);
+			if (pools) {
+				err |= topo_mem_place(
+					&topo,
+					pool_dom.base +
+						pool_dom.arena_bytes * t,
+					pool_dom.arena_bytes, slots[t].node);
+			}
+		}
+		break;
+	case TOPO_MEM_INTERLEAVE:
+		err |= topo_mem_place(&topo, node_mem, len * thr_max, -1);
+		if (wl_mem) {
+			err |= topo_mem_place(&topo, wl_mem,
+					      stride_max * wl.keys, -1);
+		}
+		if (pools) {
+			err |= topo_mem_place(&topo, pool_dom.base,
+					      pool_dom.arena_bytes * thr_max,
+					      -1);
+		}
+		break;
+	case TOPO_MEM_DEFAULT:
+	default:
+		break;
+	}
+	return err;
+}
+
+static int bench_alloc(const struct bench_opts *o)
+{
+	bool need_pool = false;
+
+	for (size_t i = 0; i < o->impl_num; ++i) {
+		need_pool |= o->impls[i]->zhang;
+		if (o->impls[i]->node_size > stride_max) {
+			stride_max = o->impls[i]->node_size;
 		}
 	}
+	stride_max += node_pad();
+	thr_max = list_max(o->thr_nums, o->thr_num_len);
+	ops_max = list_max(o->ops_nums, o->ops_num_len);
 
+	slots = calloc(thr_max, sizeof(*slots));
+	if (!slots || topo_init(&topo) != 0 ||
+	    topo_plan(&topo, &o->pin, slots, thr_max) != 0) {
+		printf("Failed to place %lu threads (is every listed CPU "
+		       "available?)\n",
+		       thr_max);
+		return -1;
+	}
+	tids = calloc(thr_max, sizeof(*tids));
+	targs = calloc(thr_max, sizeof(*targs));
+	/* Records are cache line aligned, calloc doesn't guarantee that */
+	hps = aligned_alloc(CACHELINE_BYTES, sizeof(*hps) * thr_max);
+	/* One spare EBR record for Zhang's janitor */
+	ebrs = aligned_alloc(CACHELINE_BYTES, sizeof(*ebrs) * (thr_max + 1));
+	hes = aligned_alloc(CACHELINE_BYTES, sizeof(*hes) * thr_max);
+	lats = aligned_alloc(CACHELINE_BYTES, sizeof(*lats) * thr_max);
+	lat_sum = aligned_alloc(CACHELINE_BYTES, sizeof(*lat_sum));
+	ctrs = aligned_alloc(CACHELINE_BYTES, sizeof(*ctrs) * thr_max);
+	node_mem = calloc(thr_max * ops_max, stride_max);
+	if (o->mix) {
+		wl.keys = o->wl.keys;
+		wl_mem = calloc(wl.keys, stride_max);
+		wl.state = calloc(wl.keys, sizeof(*wl.state));
+		wl_ops = calloc(thr_max * ops_max, sizeof(*wl_ops));
+		wl_pre = calloc(wl.keys, sizeof(*wl_pre));
+		if (!wl_mem || !wl.state || !wl_ops || !wl_pre) {
+			printf("Failed to allocate %lu keys\n", wl.keys);
+			return -1;
+		}
+	}
+	if (need_pool) {
+		pools = aligned_alloc(CACHELINE_BYTES,
+				      sizeof(*pools) * thr_max);
+	}
+	if (!tids || !targs || !hps || !ebrs || !hes || !lats ||
+	    !lat_sum || !ctrs || !node_mem ||
+	    (need_pool && !pools)) {
+		printf("Failed to allocate %lu threads x %lu operations\n",
+		       thr_max, ops_max);
+		return -1;
+	}
+
+	/* Every delete of a run may take a dummy before any is reclaimed */
+	if (need_pool && pool_domain_init(&pool_dom, pools, thr_max,
+					  sizeof(struct zhang_node), ops_max,
+					  o->huge) != 0) {
+		printf("Failed to reserve the node pool\n");
+		return -1;
+	}
+	if (bench_place(o) != 0) {
+		printf("Failed to place node memory (%s)\n",
+		       topo_mem_name(o->mem));
+		return -1;
+	}
+	if (hp_domain_init(&hp_dom, hps, thr_max, bench_reclaim, NULL) != 0) {
+		printf("Failed to allocate hazard pointer domain\n");
+		return -1;
+	}
+	ebr_domain_init(&ebr_dom, ebrs, thr_max + 1, bench_reclaim, NULL);
+	if (he_domain_init(&he_dom, hes, thr_max, bench_reclaim, NULL) != 0) {
+		printf("Failed to allocate hazard era domain\n");
+		return -1;
+	}
 	return 0;
 }
+
+static void bench_free(struct bench_opts *o)
+{
+	hp_domain_destroy(&hp_dom);
+	he_domain_destroy(&he_dom);
+	free(wl_pre);
+	free(wl_ops);
+	free(wl.state);
+	free(wl_mem);
+	pool_domain_destroy(&pool_dom);
+	free(pools);
+	free(node_mem);
+	free(lat_sum);
+	free(ctrs);
+	free(lats);
+	free(hes);
+	free(ebrs);
+	free(hps);
+	free(targs);
+	free(tids);
+	free(slots);
+	topo_destroy(&topo);
+	free(o->pin.cpus);
+	free(o->cms);
+	free(o->read_pers);
+	free(o->ops_nums);
+	free(o->thr_nums);
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench_opts o;
+	int err;
+
+	err = parse_opts(argc, argv, &o);
+	if (err != 0) {
+		return err > 0 ? 0 : 1;
+	}
+	for (size_t i = 0; i < o.impl_num; ++i) {
+		if (o.impls[i]->epoch &&
+		    (smr_mode == SMR_HP || smr_mode == SMR_HE)) {
+			printf("%s only supports { ebr, qsbr }\n",
+			       o.impls[i]->name);
+			return 1;
+		}
+	}
+	if (bench_alloc(&o) != 0) {
+		return 1;
+	}
+	tsc_init();
+	if (o.perf && !perf_usable()) {
+		o.perf = false;
+	}
+	if (o.mix) {
+		wl_cfg_prepare(&o.wl);
+	}
+	output_begin(&o);
+
+	for (size_t impl = 0; impl < o.impl_num; ++impl) {
+		for (size_t opidx = 0; opidx < o.ops_num_len; ++opidx) {
+			for (size_t ridx = 0; ridx < o.read_per_len; ++ridx) {
+				for (size_t tidx = 0; tidx < o.thr_num_len;
+				     ++tidx) {
+					int64_t opn =
+						(int64_t)o.ops_nums[opidx];
+					uint64_t rper = o.read_pers[ridx];
+					uint64_t thrn = o.thr_nums[tidx];
+
+					/* Every manager in turn, so their runs
+					 * of a config are next to each other
+					 */
+					for (uint64_t run = 0;
+					     run < o.cm_num * o.reps; ++run) {
+						cm_cfg = o.cms[run / o.reps];
+						if (execute(&o, o.impls[impl],
+							    run % o.reps, thrn,
+							    opn, rper) != 0) {
+							bench_free(&o);
+							return 1;
+						}
+					}
+				}
+			}
+		}
+	}
+	output_end(o.format);
+
+	bench_free(&o);
+	return results_failed ? 1 : 0;
+}
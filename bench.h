@@ -3,20 +3,53 @@
 
 #include <stdlib.h>
 
+#include "ebr.h"
+#include "he.h"
+#include "lat.h"
 #include "lf.h"
+#include "pool.h"
+#include "smr.h"
+#include "wl.h"
+
+struct so_set;
 
 struct thr_arg {
 	uint64_t tidx;
 	lfhead_t *head;
 	lfhead_t *head_ret;
-	lfhead_t *dummies;
+	/* Zhang's delete dummies, NULL for everything else */
+	pool_tls_t *pool;
+	/* Dummies this thread enlisted, oldest first (zhang.c). Kept across
+	 * runs, zhang_setup returns them to the pool.
+	 */
+	lfhead_t *dummy_first;
+	lfhead_t *dummy_last;
+	/* INV nodes Zhang's janitor unlinks per pass, 0 runs without one */
+	uint64_t compact;
+	/* Split-ordered hash set over head (so.h) */
+	struct so_set *so;
 	hp_tls_t *hp_tls;
+	ebr_tls_t *ebr_tls;
+	he_tls_t *he_tls;
+	enum smr_mode smr_mode;
 	unsigned int randseed;
+	lat_tls_t *lat;
+	/* Hot path events, see ctr.h */
+	ctr_tls_t *ctr;
 
 	int64_t read_ops;
 
+	/* node_num phase nodes, node_stride bytes apart */
 	lfhead_t *nodes;
 	size_t node_num;
+	size_t node_stride;
+
+	/* Mixed workload (wl.h), NULL runs the phases below instead */
+	struct wl *wl;
+	const struct wl_op *wl_ops;
+	size_t wl_op_num;
+	/* Claimed inserts/deletes the list reported as failed */
+	uint64_t wl_errors;
 };
 typedef struct thr_arg thr_arg_t;
 
@@ -35,14 +68,25 @@ inline static size_t rand_insert_n(unsigned int *seed, size_t max_ins)
 	thr_arg_t *arg = (thr_arg_t *)(varg);    \
 	lfhead_t *head = (arg)->head;            \
 	lfhead_t *head_ret = (arg)->head_ret;    \
-	lfhead_t *dummies = (arg)->dummies;      \
+	pool_tls_t *pool = (arg)->pool;          \
 	hp_tls_t *hp_tls = (arg)->hp_tls;        \
+	smr_tls_t smr_tls = { (arg)->smr_mode,   \
+			      (arg)->hp_tls,     \
+			      (arg)->ebr_tls,    \
+			      (arg)->he_tls };   \
 	unsigned int *seed = &((arg)->randseed); \
+	lat_tls_t *lat = (arg)->lat;             \
+	struct wl *wl = (arg)->wl;               \
 	int64_t rops = (arg)->read_ops;          \
 	lfhead_t *nodes = (arg)->nodes;          \
 	size_t node_num = (arg)->node_num;       \
+	size_t node_stride = (arg)->node_stride; \
 	size_t rand_ins = rand_insert_n(seed, node_num);
 
+#define phase_node(idx) \
+	((lfhead_t *)(void *)((char *)nodes + node_stride * (size_t)(idx)))
+#define phase_key(idx) (to_lfkey(phase_node(idx))->key)
+
 #define insert_phase_foreach(idx_name) \
 	for (unsigned int idx_name = 0; idx_name < rand_ins; ++idx_name)
 
@@ -62,14 +106,37 @@ inline static size_t rand_insert_n(unsigned int *seed, size_t max_ins)
 #define finish_insdel_phase_foreach(idx_name) \
 	for (; idx_name < node_num; ++idx_name)
 
+#define wl_foreach(op_name)                                     \
+	for (const struct wl_op *op_name = (arg)->wl_ops;       \
+	     op_name < (arg)->wl_ops + (arg)->wl_op_num; ++op_name)
+
 void *lock_trfunc(void *arg);
 void *harris_trfunc(void *arg);
+void *harris_search_trfunc(void *arg);
 void *michael_trfunc(void *arg);
 void *zhang_trfunc(void *arg);
+void *zhang_nodup_trfunc(void *arg);
+void *zhang_wf_trfunc(void *arg);
+void *harris_sorted_trfunc(void *arg);
+void *michael_sorted_trfunc(void *arg);
+void *so_trfunc(void *arg);
+void *sl_trfunc(void *arg);
+void *dll_trfunc(void *arg);
+
+int zhang_setup(thr_arg_t *args, uint64_t thrn);
+int zhang_wf_setup(thr_arg_t *args, uint64_t thrn);
+int so_setup(thr_arg_t *args, uint64_t thrn);
+int sl_setup(thr_arg_t *args, uint64_t thrn);
+
+void zhang_gauge(thr_arg_t *arg, uint64_t *live, uint64_t *inv);
 
 void lock_cleanup(thr_arg_t *arg);
 void harris_cleanup(thr_arg_t *arg);
 void michael_cleanup(thr_arg_t *arg);
 void zhang_cleanup(thr_arg_t *arg);
+void zhang_wf_cleanup(thr_arg_t *arg);
+void so_cleanup(thr_arg_t *arg);
+void sl_cleanup(thr_arg_t *arg);
+void dll_cleanup(thr_arg_t *arg);
 
 #endif /* BENCH_H */
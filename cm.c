@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lf.h"
+
+struct cm_cfg cm_cfg = { CM_NONE, CM_BACKOFF_MIN, CM_BACKOFF_MAX };
+
+int cm_cfg_parse(const char *str, struct cm_cfg *c)
+{
+	unsigned long min, max;
+	char *end;
+
+	c->min = CM_BACKOFF_MIN;
+	c->max = CM_BACKOFF_MAX;
+	if (strcmp(str, "none") == 0) {
+		c->policy = CM_NONE;
+		return 0;
+	}
+	if (strncmp(str, "backoff", 7) != 0) {
+		return -1;
+	}
+	c->policy = CM_BACKOFF;
+	if (str[7] == '\0') {
+		return 0;
+	}
+	if (str[7] != ':') {
+		return -1;
+	}
+	min = strtoul(str + 8, &end, 10);
+	if (*end != ':') {
+		return -1;
+	}
+	max = strtoul(end + 1, &end, 10);
+	/* ck_backoff_eb stops doubling at CK_BACKOFF_CEILING */
+	if (*end != '\0' || min == 0 || min > max ||
+	    max > CK_BACKOFF_CEILING) {
+		return -1;
+	}
+	c->min = (unsigned int)min;
+	c->max = (unsigned int)max;
+	return 0;
+}
+
+void cm_cfg_name(const struct cm_cfg *c, char *buf, size_t len)
+{
+	switch (c->policy) {
+	case CM_NONE:
+		snprintf(buf, len, "none");
+		break;
+	case CM_BACKOFF:
+		snprintf(buf, len, "backoff:%u:%u", c->min, c->max);
+		break;
+	default:
+		snprintf(buf, len, "?");
+		break;
+	}
+}
@@ -0,0 +1,60 @@
+#ifndef CM_H
+#define CM_H
+
+#include <stddef.h>
+
+#include <ck_backoff.h>
+
+/* Contention management for the CASes every thread aims at one word: the
+ * head->next of a list's head inserts and the HP retire stack's next_ret.
+ * A thread that loses one waits before retrying, so the line isn't pulled
+ * away from the winner by every loser at once. Only include it through lf.h,
+ * like ctr.h. The policy is global and set before the threads start; the
+ * success path never reads it.
+ */
+
+enum cm_policy {
+	/* Retry at once */
+	CM_NONE,
+	/* ck_backoff_eb: spin min iterations after the first failure, twice
+	 * as many after each next one, up to max
+	 */
+	CM_BACKOFF,
+};
+
+#define CM_BACKOFF_MIN (16)
+#define CM_BACKOFF_MAX (4096)
+
+struct cm_cfg {
+	enum cm_policy policy;
+	unsigned int min;
+	unsigned int max;
+};
+
+extern struct cm_cfg cm_cfg;
+
+/* One per operation, on the stack: cm_t b = CM_INITIALIZER; */
+typedef ck_backoff_t cm_t;
+#define CM_INITIALIZER (0)
+
+/* Call after a failed CAS, before retrying it */
+inline static void cm_fail(cm_t *b)
+{
+	if (cm_cfg.policy == CM_NONE) {
+		return;
+	}
+	CTR_INC(CTR_BACKOFF);
+	if (*b == 0) {
+		*b = cm_cfg.min;
+	}
+	ck_backoff_eb(b);
+	if (*b > cm_cfg.max) {
+		*b = cm_cfg.max;
+	}
+}
+
+/* "none" or "backoff[:min:max]" */
+int cm_cfg_parse(const char *str, struct cm_cfg *c);
+void cm_cfg_name(const struct cm_cfg *c, char *buf, size_t len);
+
+#endif /* CM_H */
@@ -0,0 +1,36 @@
+#include <stddef.h>
+
+#include "lf.h"
+
+static const char *const ctr_names[] = {
+	[CTR_CAS] = "cas",
+	[CTR_CAS_FAIL] = "cas_fail",
+	[CTR_RESTART_MARKED] = "restart_marked",
+	[CTR_RESTART_VALIDATE] = "restart_validate",
+	[CTR_RESTART_CAS] = "restart_cas",
+	[CTR_TRAVERSE] = "traverse",
+	[CTR_SKIP] = "skip",
+	[CTR_HP_REPOST] = "hp_repost",
+	[CTR_BACKOFF] = "backoff",
+};
+
+#if BENCH_COUNTERS
+/* Shared by every unbound thread, so its counts are garbage */
+static ctr_tls_t ctr_sink;
+
+__thread ctr_tls_t *ctr_self = &ctr_sink;
+#endif
+
+void ctr_bind(ctr_tls_t *c)
+{
+#if BENCH_COUNTERS
+	ctr_self = c ? c : &ctr_sink;
+#else
+	(void)c;
+#endif
+}
+
+const char *ctr_event_name(enum ctr_event e)
+{
+	return ctr_names[e];
+}
@@ -0,0 +1,69 @@
+#ifndef CTR_H
+#define CTR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Hot path event counters, to see why one list beats another. They cost an
+ * increment per event, so they are compiled out unless the bench is built
+ * with -DBENCH_COUNTERS=1. Only include it through lf.h (it needs
+ * CACHELINE_BYTES), which makes it available to every list and to hp_post.
+ * Each thread points ctr_self at its own record before its first operation
+ * and the bench sums them after join.
+ */
+#ifndef BENCH_COUNTERS
+#define BENCH_COUNTERS (0)
+#endif
+
+enum ctr_event {
+	/* Every CAS a list or the HP retire stack attempts */
+	CTR_CAS,
+	CTR_CAS_FAIL,
+	/* Walks started over because they met a marked pointer */
+	CTR_RESTART_MARKED,
+	/* ... because re-reading prev or curr showed a change */
+	CTR_RESTART_VALIDATE,
+	/* ... because a CAS on the list failed */
+	CTR_RESTART_CAS,
+	/* Nodes a walk stepped onto */
+	CTR_TRAVERSE,
+	/* Of those, INV (Zhang) or marked nodes stepped over */
+	CTR_SKIP,
+	/* Hazards posted again since the source changed under them */
+	CTR_HP_REPOST,
+	/* Waits after a lost head or retire stack CAS, see cm.h */
+	CTR_BACKOFF,
+	CTR_NUM,
+};
+
+struct ctr_tls {
+	uint64_t ev[CTR_NUM];
+} __attribute__((aligned(CACHELINE_BYTES)));
+typedef struct ctr_tls ctr_tls_t;
+
+#if BENCH_COUNTERS
+extern __thread ctr_tls_t *ctr_self;
+
+#define CTR_ADD(event, n) (ctr_self->ev[(event)] += (n))
+#else
+#define CTR_ADD(event, n) ((void)0)
+#endif
+#define CTR_INC(event) CTR_ADD(event, 1)
+
+/* Wraps a CAS: if (ctr_cas(ck_pr_cas_ptr(...))) */
+inline static bool ctr_cas(bool ok)
+{
+	CTR_INC(CTR_CAS);
+	if (!ok) {
+		CTR_INC(CTR_CAS_FAIL);
+	}
+	return ok;
+}
+
+/* Threads that never bind a record (or bind NULL) count into a sink nobody
+ * reads.
+ */
+void ctr_bind(ctr_tls_t *c);
+const char *ctr_event_name(enum ctr_event e);
+
+#endif /* CTR_H */
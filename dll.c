@@ -0,0 +1,253 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <ck_pr.h>
+
+#include "bench.h"
+#include "lf.h"
+#include "smr.h"
+
+/* Intrusive doubly linked list: inserts go to the front and deletes take the
+ * node itself. next is the real list (Harris marking, as in michael.c), prev
+ * only a hint of which node points to us. A delete marks the node, then
+ * unlinks it from its prev in O(1) if prev is a linked node whose next is
+ * still us. A stale hint (prev was deleted, or hasn't been fixed up yet
+ * after an insert) falls back to Michael's search from head, which snips
+ * marked nodes on the way. Nodes are struct dll_node (lf.h).
+ *
+ * prev is read without a pointer to validate the hazard against, so nodes
+ * must be type stable: reclaimed nodes are reused as nodes, never handed
+ * back to the system, like everywhere in the bench. The hazard still keeps
+ * the node from being reused while we look at it, and linked (cleared
+ * before a node is reinserted) tells a linked predecessor from one that is
+ * being inserted again.
+ */
+
+/* A delete pins its own node past the three walking slots */
+#define DLL_HP_SELF (HP_PREV + 1)
+
+/* Whoever unlinks x retires it */
+inline static bool dll_unlink(lfhead_t *head, lfhead_t *p, lfhead_t *x,
+			      lfhead_t *n, smr_tls_t *smr)
+{
+	if (!ctr_cas(ck_pr_cas_ptr(&p->next, x, n))) {
+		return false;
+	}
+	if (n != head) {
+		ctr_cas(ck_pr_cas_ptr(&to_dll_node(n)->prev, x, p));
+	}
+	smr_retire(smr, x);
+	return true;
+}
+
+/* Slow path, returns once t is unlinked */
+static void dll_search(lfhead_t *head, lfhead_t *t, smr_tls_t *smr)
+{
+	lfhead_t *prev, *curr, *next;
+
+try_again:
+	prev = head;
+	curr = smr_protect(smr, &head->next, HP_CURR);
+	while (curr != head) {
+		CTR_INC(CTR_TRAVERSE);
+		next = smr_protect(smr, &curr->next, HP_NEXT);
+		if (ck_pr_load_ptr(&prev->next) != curr) {
+			CTR_INC(CTR_RESTART_VALIDATE);
+			goto try_again;
+		}
+		if (is_marked(next)) {
+			CTR_INC(CTR_SKIP);
+			if (!dll_unlink(head, prev, curr, unmark(next), smr)) {
+				CTR_INC(CTR_RESTART_CAS);
+				goto try_again;
+			}
+			if (curr == t) {
+				return;
+			}
+			curr = unmark(next);
+			smr_inherit(smr, HP_NEXT, HP_CURR);
+			continue;
+		}
+		prev = curr;
+		smr_inherit(smr, HP_CURR, HP_PREV);
+		curr = next;
+		smr_inherit(smr, HP_NEXT, HP_CURR);
+	}
+}
+
+inline static void dll_insert(lfhead_t *restrict head, lfhead_t *restrict new,
+			      smr_tls_t *restrict smr)
+{
+	struct dll_node *d = to_dll_node(new);
+	lfhead_t *first, *p;
+	cm_t b = CM_INITIALIZER;
+
+	smr_begin(smr);
+	smr_birth(smr, new);
+	ck_pr_store_64(&d->linked, 0);
+	d->prev = head;
+	ck_pr_fence_store();
+	first = smr_protect(smr, &head->next, HP_NEXT);
+	while (1) {
+		ck_pr_store_ptr(&new->next, first);
+		if (ctr_cas(ck_pr_cas_ptr(&head->next, first, new))) {
+			break;
+		}
+		cm_fail(&b);
+		first = smr_protect(smr, &head->next, HP_NEXT);
+	}
+	ck_pr_store_64(&d->linked, 1);
+	/* Only a hint, losing a race here sends a delete down the slow path */
+	if (first != head) {
+		p = ck_pr_load_ptr(&to_dll_node(first)->prev);
+		if (ck_pr_load_ptr(&new->next) == first) {
+			ctr_cas(ck_pr_cas_ptr(&to_dll_node(first)->prev, p,
+					      new));
+		}
+	}
+	smr_end(smr);
+}
+
+/* x must be held by the caller and its insert done. False if someone else
+ * deleted it first.
+ */
+inline static bool dll_delete(lfhead_t *restrict head, lfhead_t *x,
+			      smr_tls_t *restrict smr)
+{
+	lfhead_t *next, *p;
+	bool result = false;
+
+	smr_begin(smr);
+	/* Nothing retires x before it is marked, so this pin holds */
+	smr_protect(smr, &x, DLL_HP_SELF);
+	next = ck_pr_load_ptr(&x->next);
+	while (1) {
+		if (is_marked(next)) {
+			goto out;
+		}
+		if (ctr_cas(ck_pr_cas_ptr_value(&x->next, next, mark(next),
+						&next))) {
+			break;
+		}
+	}
+	result = true;
+	while (1) {
+		p = smr_protect(smr, &to_dll_node(x)->prev, HP_PREV);
+		/* next before linked, the reverse of the order dll_insert
+		 * stores them in: a p->next == x written by a reinsert of p
+		 * comes after its linked = 0, so linked can't be the stale 1
+		 * of p's previous life.
+		 */
+		if (ck_pr_load_ptr(&p->next) != x) {
+			break;
+		}
+		ck_pr_fence_load();
+		if (p != head && !ck_pr_load_64(&to_dll_node(p)->linked)) {
+			break;
+		}
+		if (dll_unlink(head, p, x, unmark(next), smr)) {
+			goto out;
+		}
+		CTR_INC(CTR_RESTART_CAS);
+	}
+	/* The hint was stale, so the O(1) unlink became a walk */
+	CTR_INC(CTR_RESTART_VALIDATE);
+	dll_search(head, x, smr);
+out:
+	smr_clear_slots(smr, DLL_HP_SELF, DLL_HP_SELF + 1);
+	smr_end(smr);
+	return result;
+}
+
+/* O(1): present once its insert linked it and until it is marked */
+inline static bool dll_contains(lfhead_t *x)
+{
+	uint64_t linked = ck_pr_load_64(&to_dll_node(x)->linked);
+
+	ck_pr_fence_load();
+	return linked && is_unmarked(ck_pr_load_ptr(&x->next));
+}
+
+void *dll_trfunc(void *varg)
+{
+	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  dll_insert(head, x.node, smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = dll_delete(head, x.node, smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  dll_contains(x.node));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
+	}
+
+	insert_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  dll_insert(head, phase_node(i), smr));
+	}
+	find_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_FIND, dll_contains(phase_node(i)));
+	}
+	delete_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_DELETE,
+			  dll_delete(head, phase_node(i), smr));
+	}
+
+	all_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  dll_insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_FIND, dll_contains(phase_node(i)));
+		LAT_TIMED(lat, LAT_DELETE,
+			  dll_delete(head, phase_node(i), smr));
+	}
+	finish_find_phase_foreach()
+	{
+		LAT_TIMED(lat, LAT_FIND, dll_contains(phase_node(rops)));
+	}
+	finish_insdel_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  dll_insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  dll_delete(head, phase_node(i), smr));
+	}
+	smr_thread_stop(smr);
+	pthread_exit(NULL);
+}
+
+/* Every delete unlinks its node before returning */
+void dll_cleanup(thr_arg_t *arg)
+{
+	(void)arg;
+}
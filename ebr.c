@@ -0,0 +1,127 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "ebr.h"
+#include "lf.h"
+
+static void ebr_free_limbo(ebr_tls_t *t, struct ebr_limbo *l)
+{
+	ebr_domain_t *d = t->dom;
+	lfhead_t *node;
+
+	while (l->head) {
+		node = l->head;
+		l->head = node->next_ret;
+		if (d->reclaim) {
+			d->reclaim(node, d->reclaim_ctx);
+		}
+		++t->reclaimed;
+	}
+	l->num = 0;
+}
+
+void ebr_domain_init(ebr_domain_t *d, ebr_tls_t *recs, uint64_t rec_num,
+		     lf_reclaim_fn reclaim, void *reclaim_ctx)
+{
+	d->epoch = 0;
+	d->recs = recs;
+	d->rec_num = rec_num;
+	d->reclaim = reclaim;
+	d->reclaim_ctx = reclaim_ctx;
+
+	for (uint64_t i = 0; i < rec_num; ++i) {
+		ebr_tls_t *t = &recs[i];
+
+		t->epoch = 0;
+		t->dom = d;
+		t->active = 0;
+		t->retired = 0;
+		t->reclaimed = 0;
+		for (int j = 0; j < EBR_LIMBO; ++j) {
+			t->limbo[j].head = NULL;
+			t->limbo[j].num = 0;
+			t->limbo[j].epoch = 0;
+		}
+	}
+}
+
+void ebr_domain_drain(ebr_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		for (int j = 0; j < EBR_LIMBO; ++j) {
+			ebr_free_limbo(&d->recs[i], &d->recs[i].limbo[j]);
+		}
+		d->recs[i].retired = 0;
+	}
+}
+
+void ebr_domain_stats(ebr_domain_t *d, uint64_t *reclaimed, uint64_t *pending)
+{
+	*reclaimed = 0;
+	*pending = 0;
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		*reclaimed += d->recs[i].reclaimed;
+		for (int j = 0; j < EBR_LIMBO; ++j) {
+			*pending += d->recs[i].limbo[j].num;
+		}
+	}
+}
+
+ebr_tls_t *ebr_register(ebr_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		ebr_tls_t *t = &d->recs[i];
+
+		if (ck_pr_load_uint(&t->active) == 0 &&
+		    ck_pr_cas_uint(&t->active, 0, 1)) {
+			return t;
+		}
+	}
+
+	return NULL;
+}
+
+/* Limbo lists stay on the record for the next thread to register it */
+void ebr_unregister(ebr_tls_t *t)
+{
+	ck_pr_store_64(&t->epoch, 0);
+	ebr_collect(t);
+	ck_pr_store_uint(&t->active, 0);
+}
+
+static bool ebr_try_advance(ebr_domain_t *d, uint64_t e)
+{
+	ck_pr_fence_memory();
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		uint64_t te = ck_pr_load_64(&d->recs[i].epoch);
+
+		if ((te & EBR_ACTIVE) && (te >> 1) != e) {
+			return false;
+		}
+	}
+
+	return ck_pr_cas_64(&d->epoch, e, e + 1);
+}
+
+void ebr_collect(ebr_tls_t *t)
+{
+	ebr_domain_t *d = t->dom;
+	uint64_t e = ck_pr_load_64(&d->epoch);
+
+	t->retired = 0;
+	if (ebr_try_advance(d, e)) {
+		++e;
+	} else {
+		e = ck_pr_load_64(&d->epoch);
+	}
+
+	for (int i = 0; i < EBR_LIMBO; ++i) {
+		struct ebr_limbo *l = &t->limbo[i];
+
+		if (l->num > 0 && l->epoch + 2 <= e) {
+			ebr_free_limbo(t, l);
+		}
+	}
+}
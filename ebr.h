@@ -0,0 +1,127 @@
+#ifndef EBR_H
+#define EBR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "lf.h"
+
+/* Nodes retired in epoch e are freed once the global epoch reaches e + 2.
+ * At that point every thread that could have seen them has left the
+ * critical section it was in when they were unlinked.
+ */
+#define EBR_LIMBO (3)
+#define EBR_ACTIVE ((uint64_t)1)
+#define EBR_RETIRE_BATCH (64)
+
+struct ebr_limbo {
+	lfhead_t *head;
+	uint64_t num;
+	uint64_t epoch;
+};
+
+struct ebr_domain;
+
+struct ebr_tls {
+	/* Announced epoch << 1 | EBR_ACTIVE. Read by every advancer. */
+	uint64_t epoch;
+	/* Owner-only from here on */
+	struct ebr_domain *dom __attribute__((aligned(CACHELINE_BYTES)));
+	unsigned int active;
+	uint64_t retired;
+	uint64_t reclaimed;
+	struct ebr_limbo limbo[EBR_LIMBO];
+} __attribute__((aligned(CACHELINE_BYTES)));
+typedef struct ebr_tls ebr_tls_t;
+
+struct ebr_domain {
+	uint64_t epoch __attribute__((aligned(CACHELINE_BYTES)));
+	ebr_tls_t *recs __attribute__((aligned(CACHELINE_BYTES)));
+	uint64_t rec_num;
+	lf_reclaim_fn reclaim;
+	void *reclaim_ctx;
+};
+typedef struct ebr_domain ebr_domain_t;
+
+/* Same conventions as hp_domain_init. */
+void ebr_domain_init(ebr_domain_t *d, ebr_tls_t *recs, uint64_t rec_num,
+		     lf_reclaim_fn reclaim, void *reclaim_ctx);
+/* Only safe when no thread is registered. Reclaims every pending node. */
+void ebr_domain_drain(ebr_domain_t *d);
+void ebr_domain_stats(ebr_domain_t *d, uint64_t *reclaimed, uint64_t *pending);
+
+ebr_tls_t *ebr_register(ebr_domain_t *d);
+void ebr_unregister(ebr_tls_t *t);
+/* Tries to advance the global epoch, then frees what is old enough */
+void ebr_collect(ebr_tls_t *t);
+
+inline static void ebr_enter(ebr_tls_t *t)
+{
+	uint64_t e = ck_pr_load_64(&t->dom->epoch);
+
+	ck_pr_store_64(&t->epoch, (e << 1) | EBR_ACTIVE);
+	/* The announcement has to be visible before any list pointer is read */
+	ck_pr_fence_memory();
+}
+
+inline static void ebr_exit(ebr_tls_t *t)
+{
+	ck_pr_fence_release();
+	ck_pr_store_64(&t->epoch, t->epoch & ~EBR_ACTIVE);
+}
+
+/* QSBR runs on the same records and limbo lists. A thread stays announced
+ * (EBR_ACTIVE) for as long as it is online and only refreshes its epoch
+ * between operations, so readers pay nothing per operation or per hop.
+ * Going offline is required before a thread blocks or exits, otherwise it
+ * stalls every grace period.
+ */
+inline static void qsbr_quiescent(ebr_tls_t *t)
+{
+	uint64_t e = (ck_pr_load_64(&t->dom->epoch) << 1) | EBR_ACTIVE;
+
+	/* Only write when the epoch moved so advancers' loads stay shared */
+	if (t->epoch != e) {
+		ck_pr_fence_release();
+		ck_pr_store_64(&t->epoch, e);
+	}
+}
+
+inline static void qsbr_online(ebr_tls_t *t)
+{
+	uint64_t e = ck_pr_load_64(&t->dom->epoch);
+
+	ck_pr_store_64(&t->epoch, (e << 1) | EBR_ACTIVE);
+	ck_pr_fence_memory();
+}
+
+inline static void qsbr_offline(ebr_tls_t *t)
+{
+	ebr_exit(t);
+}
+
+/* tar must already be unlinked. The global epoch (not the announced one) is
+ * used because it can be one ahead of ours and readers may have entered
+ * there.
+ */
+inline static void ebr_retire(ebr_tls_t *t, lfhead_t *tar)
+{
+	uint64_t e = ck_pr_load_64(&t->dom->epoch);
+	struct ebr_limbo *l = &t->limbo[e % EBR_LIMBO];
+
+	if (l->epoch != e && l->num > 0) {
+		/* Bucket was filled at least EBR_LIMBO epochs ago */
+		ebr_collect(t);
+	}
+	l->epoch = e;
+	ck_pr_store_ptr(&tar->next_ret, l->head);
+	l->head = tar;
+	++l->num;
+	if (++t->retired >= EBR_RETIRE_BATCH) {
+		ebr_collect(t);
+	}
+}
+
+#endif /* EBR_H */
@@ -9,187 +9,531 @@
 
 #include <pf_hw_timer.h>
 
-struct lflist_head {
-	struct lflist_head *next;
-};
-typedef struct lflist_head lflist_head_t;
-typedef void lflist_head_unsafe_t;
-
-struct integer_entry {
-	lflist_head_t integers;
-	int x;
-};
-
-#define PTR_MARK ((uintptr_t)1)
-
-inline static bool is_marked(void *ptr)
-{
-	uintptr_t uptr = (uintptr_t)ptr;
-	return uptr & PTR_MARK;
-}
-
-inline static bool is_unmarked(void *ptr)
-{
-	return !is_marked(ptr);
-}
-
-inline static lflist_head_unsafe_t *mark(void *ptr)
-{
-	uintptr_t uptr = (uintptr_t)ptr;
-	return (lflist_head_unsafe_t *)(uptr | PTR_MARK);
-}
-
-inline static lflist_head_t *unmark(void *ptr)
-{
-	uintptr_t uptr = (uintptr_t)ptr;
-	return (lflist_head_t *)(uptr & ~PTR_MARK);
-}
+#include "bench.h"
+#include "lf.h"
+#include "smr.h"
 
 #define LFLIST_END(head_ptr, curr_ptr) (head_ptr == unmark(curr_ptr))
 
-#define lflist_entry(lflist_head_ptr, entry_type, entry_lflist_head_member) \
-	((entry_type *)((uintptr_t)(lflist_head_ptr) -                      \
-			offsetof(entry_type, entry_lflist_head_member)))
-
-inline static void lflist_init(struct lflist_head *head)
-{
-	head->next = head;
-}
-
-inline static void lflist_add(struct lflist_head *restrict head,
-			      struct lflist_head *restrict new)
+inline static void insert(lfhead_t *restrict head, lfhead_t *restrict new,
+			  smr_tls_t *restrict smr)
 {
-	struct lflist_head *next;
+	lfhead_t *next;
+	cm_t b = CM_INITIALIZER;
 
+	smr_begin(smr);
+	smr_birth(smr, new);
 	next = ck_pr_load_ptr(&head->next);
-	do {
+	new->next = next;
+	while (!ctr_cas(ck_pr_cas_ptr_value(&head->next, next, (void *)new,
+					    &next))) {
+		cm_fail(&b);
 		new->next = next;
-	} while (!ck_pr_cas_ptr_value(&head->next, next, (void *)new, &next));
+	}
+	smr_end(smr);
 }
 
-inline static bool lflist_del_harris(struct lflist_head *restrict head,
-				     struct lflist_head *restrict target)
+/* A marked curr means prev is being deleted and its next can't be trusted
+ * (nor used to validate a hazard), so both walks restart from head.
+ */
+inline static bool del(lfhead_t *restrict head, lfhead_t *restrict target,
+		       smr_tls_t *restrict smr)
 {
-	struct lflist_head *prev;
-	struct lflist_head *curr;
+	lfhead_t *prev, *curr, *next;
+	bool result = false;
 
+	smr_begin(smr);
+try_again:
 	prev = head;
-	curr = ck_pr_load_ptr(&head->next);
+	curr = smr_protect(smr, &head->next, HP_CURR);
 
 	while (!LFLIST_END(head, curr)) {
+		CTR_INC(CTR_TRAVERSE);
 		if (is_marked(curr)) {
-			prev = head;
-			curr = head->next;
-			continue;
+			CTR_INC(CTR_RESTART_MARKED);
+			goto try_again;
 		}
 		if (curr == target) {
-			struct lflist_head *next = ck_pr_load_ptr(&curr->next);
+			next = ck_pr_load_ptr(&curr->next);
 			while (is_unmarked(next)) {
-				if (ck_pr_cas_ptr(&curr->next, next,
-						  mark(next)))
+				if (ctr_cas(ck_pr_cas_ptr(&curr->next, next,
+							  mark(next))))
 					break;
 				next = ck_pr_load_ptr(&curr->next);
 			}
 
-			if (ck_pr_cas_ptr(&prev->next, curr, unmark(next))) {
-				return true;
-			} else {
-				prev = head;
-				curr = head->next;
-				continue;
+			if (ctr_cas(ck_pr_cas_ptr(&prev->next, curr,
+						  unmark(next)))) {
+				smr_retire(smr, curr);
+				result = true;
+				break;
 			}
+			CTR_INC(CTR_RESTART_CAS);
+			goto try_again;
 		}
 
 		prev = curr;
-		curr = curr->next;
+		smr_inherit(smr, HP_CURR, HP_PREV);
+		curr = smr_protect(smr, &prev->next, HP_CURR);
 	}
+	smr_end(smr);
+
+	return result;
+}
+
+inline static bool find(lfhead_t *restrict head, lfhead_t *restrict target,
+			smr_tls_t *restrict smr)
+{
+	lfhead_t *prev, *curr;
+	bool result = false;
+
+	smr_begin(smr);
+try_again:
+	prev = head;
+	curr = smr_protect(smr, &head->next, HP_CURR);
 
-	return false;
+	while (!LFLIST_END(head, curr)) {
+		CTR_INC(CTR_TRAVERSE);
+		if (is_marked(curr)) {
+			CTR_INC(CTR_RESTART_MARKED);
+			goto try_again;
+		}
+		if (curr == target) {
+			result = is_unmarked(ck_pr_load_ptr(&curr->next));
+			break;
+		}
+
+		prev = curr;
+		smr_inherit(smr, HP_CURR, HP_PREV);
+		curr = smr_protect(smr, &prev->next, HP_CURR);
+	}
+	smr_end(smr);
+
+	return result;
+}
+
+/* Harris's own search(), for harris_search. Rather than restarting at every
+ * marked pointer it walks over runs of marked nodes and unlinks the whole
+ * run behind the last unmarked node (left) with one CAS, and only restarts
+ * when that CAS fails. Marked nodes' next never changes again, so the run is
+ * still the same chain once the CAS is in and whoever made it retires it.
+ *
+ * Walking through marked nodes means reading nodes that may already be
+ * unlinked, which a hazard pointer (or era) can't be validated on, so this
+ * only runs under ebr and qsbr and reads the list without smr_protect.
+ *
+ * Returns target if it is in the list, unmarked, or head otherwise. *pleft
+ * is the unmarked node that pointed to it.
+ */
+static lfhead_t *search(lfhead_t *restrict head, lfhead_t *restrict target,
+			smr_tls_t *restrict smr, lfhead_t **pleft)
+{
+	lfhead_t *left, *left_next, *right, *t, *t_next;
+
+search_again:
+	t = head;
+	t_next = ck_pr_load_ptr(&head->next);
+	left = head;
+	left_next = t_next;
+	do {
+		if (is_unmarked(t_next)) {
+			left = t;
+			left_next = t_next;
+		}
+		t = unmark(t_next);
+		if (t == head) {
+			break;
+		}
+		CTR_INC(CTR_TRAVERSE);
+		t_next = ck_pr_load_ptr(&t->next);
+		if (is_marked(t_next)) {
+			CTR_INC(CTR_SKIP);
+		}
+	} while (is_marked(t_next) || t != target);
+	right = t;
+
+	if (left_next != right) {
+		if (!ctr_cas(ck_pr_cas_ptr(&left->next, left_next, right))) {
+			CTR_INC(CTR_RESTART_CAS);
+			goto search_again;
+		}
+		for (t = left_next; t != right; t = t_next) {
+			t_next = unmark(ck_pr_load_ptr(&t->next));
+			smr_retire(smr, t);
+		}
+	}
+	if (right != head && is_marked(ck_pr_load_ptr(&right->next))) {
+		CTR_INC(CTR_RESTART_MARKED);
+		goto search_again;
+	}
+	*pleft = left;
+	return right;
+}
+
+/* A failed unlink is left to search(), which can't come back with target
+ * before it is gone.
+ */
+inline static bool search_del(lfhead_t *restrict head,
+			      lfhead_t *restrict target,
+			      smr_tls_t *restrict smr)
+{
+	lfhead_t *left, *right, *next;
+	bool result = false;
+
+	smr_begin(smr);
+	while (1) {
+		right = search(head, target, smr, &left);
+		if (right != target) {
+			goto out;
+		}
+		next = ck_pr_load_ptr(&right->next);
+		if (is_unmarked(next) &&
+		    ctr_cas(ck_pr_cas_ptr(&right->next, next, mark(next)))) {
+			break;
+		}
+	}
+	if (ctr_cas(ck_pr_cas_ptr(&left->next, right, next))) {
+		smr_retire(smr, right);
+	} else {
+		search(head, target, smr, &left);
+	}
+	result = true;
+out:
+	smr_end(smr);
+	return result;
 }
 
-inline static bool lflist_empty(struct lflist_head *head)
+inline static bool search_find(lfhead_t *restrict head,
+			       lfhead_t *restrict target,
+			       smr_tls_t *restrict smr)
 {
-	struct lflist_head *next = ck_pr_load_ptr(&head->next);
+	lfhead_t *left;
+	bool result;
 
-	return LFLIST_END(head, next);
+	smr_begin(smr);
+	result = search(head, target, smr, &left) == target;
+	smr_end(smr);
+	return result;
 }
 
-static void _integer_list_print(struct lflist_head *head)
+inline static bool harris_del(lfhead_t *restrict head,
+			      lfhead_t *restrict target, bool snip,
+			      smr_tls_t *restrict smr)
 {
-	void *curr_raw = ck_pr_load_ptr(&head->next);
-	struct lflist_head *curr = unmark(curr_raw);
-	int i = 1;
+	return snip ? search_del(head, target, smr) : del(head, target, smr);
+}
 
-	printf("[0]: %p\n", head);
-	while (!LFLIST_END(head, curr_raw)) {
-		struct integer_entry *e;
+inline static bool harris_find(lfhead_t *restrict head,
+			       lfhead_t *restrict target, bool snip,
+			       smr_tls_t *restrict smr)
+{
+	return snip ? search_find(head, target, smr) : find(head, target, smr);
+}
 
-		curr = unmark(curr_raw);
+/* Sorted variant: nodes are kept in ascending key order and every walk stops
+ * at the first node whose key is >= the one searched for. Unlike the walks
+ * above, a walk that meets a marked node unlinks it (like michael_search)
+ * and whoever unlinks a node retires it, so nothing waits on the thread that
+ * marked it.
+ *
+ * On return curr is the first unmarked node with a key >= key (or head) and
+ * prev the node that pointed to it, both protected.
+ */
+inline static void sorted_search(lfhead_t *restrict head, uint64_t key,
+				 smr_tls_t *restrict smr, lfhead_t **pprev,
+				 lfhead_t **pcurr)
+{
+	lfhead_t *prev, *curr, *next;
 
-		if (is_marked(curr_raw)) {
-			curr_raw = curr->next;
+try_again:
+	prev = head;
+	curr = smr_protect(smr, &head->next, HP_CURR);
+
+	while (curr != head) {
+		CTR_INC(CTR_TRAVERSE);
+		next = smr_protect(smr, &curr->next, HP_NEXT);
+		/* Also fails if prev got marked */
+		if (ck_pr_load_ptr(&prev->next) != curr) {
+			CTR_INC(CTR_RESTART_VALIDATE);
+			goto try_again;
+		}
+		if (is_marked(next)) {
+			CTR_INC(CTR_SKIP);
+			if (!ctr_cas(ck_pr_cas_ptr(&prev->next, curr,
+						   unmark(next)))) {
+				CTR_INC(CTR_RESTART_CAS);
+				goto try_again;
+			}
+			smr_retire(smr, curr);
+			curr = unmark(next);
+			smr_inherit(smr, HP_NEXT, HP_CURR);
 			continue;
 		}
-		e = lflist_entry(curr, struct integer_entry, integers);
+		if (LF_KEY_CMP(to_lfkey(curr)->key, key) >= 0) {
+			break;
+		}
+		prev = curr;
+		smr_inherit(smr, HP_CURR, HP_PREV);
+		curr = next;
+		smr_inherit(smr, HP_NEXT, HP_CURR);
+	}
+	*pprev = prev;
+	*pcurr = curr;
+}
 
-		printf("[%d]: %p -> %d\n", i, curr, e->x);
+/* False if key is already in the list */
+inline static bool sorted_insert(lfhead_t *restrict head, lfhead_t *restrict new,
+				 smr_tls_t *restrict smr)
+{
+	uint64_t key = to_lfkey(new)->key;
+	lfhead_t *prev, *curr;
+	bool result;
+
+	smr_begin(smr);
+	smr_birth(smr, new);
+	while (1) {
+		/* A deleted duplicate has been unlinked on the way */
+		sorted_search(head, key, smr, &prev, &curr);
+		if (curr != head && LF_KEY_CMP(to_lfkey(curr)->key, key) == 0) {
+			result = false;
+			break;
+		}
+		new->next = curr;
+		/* Fails if prev got marked, or something went in between */
+		if (ctr_cas(ck_pr_cas_ptr(&prev->next, curr, new))) {
+			result = true;
+			break;
+		}
+		CTR_INC(CTR_RESTART_CAS);
+	}
+	smr_end(smr);
+	return result;
+}
 
-		curr_raw = ck_pr_load_ptr(&curr->next);
-		i += 1;
+inline static bool sorted_remove(lfhead_t *restrict head, uint64_t key,
+				 smr_tls_t *restrict smr)
+{
+	lfhead_t *prev, *curr, *next;
+	bool result = false;
+
+	smr_begin(smr);
+	sorted_search(head, key, smr, &prev, &curr);
+	if (LFLIST_END(head, curr) ||
+	    LF_KEY_CMP(to_lfkey(curr)->key, key) != 0) {
+		goto out;
 	}
+	next = ck_pr_load_ptr(&curr->next);
+	while (1) {
+		if (is_marked(next)) {
+			/* Another remover owns it */
+			goto out;
+		}
+		if (ctr_cas(ck_pr_cas_ptr_value(&curr->next, next, mark(next),
+						&next))) {
+			break;
+		}
+	}
+	result = true;
+	if (ctr_cas(ck_pr_cas_ptr(&prev->next, curr, next))) {
+		smr_retire(smr, curr);
+	} else {
+		/* Someone changed prev, the search unlinks curr for us */
+		CTR_INC(CTR_RESTART_CAS);
+		sorted_search(head, key, smr, &prev, &curr);
+	}
+out:
+	smr_end(smr);
+	return result;
 }
 
-struct thread_arg {
-	lflist_head_t *head;
-	int idx;
-};
+inline static bool sorted_contains(lfhead_t *restrict head, uint64_t key,
+				   smr_tls_t *restrict smr)
+{
+	lfhead_t *prev, *curr;
+	bool result;
+
+	smr_begin(smr);
+	sorted_search(head, key, smr, &prev, &curr);
+	result = curr != head && LF_KEY_CMP(to_lfkey(curr)->key, key) == 0;
+	smr_end(smr);
+	return result;
+}
 
-static void *pthread_runner(void *arg)
+static void *harris_run(void *varg, bool snip)
 {
-	struct thread_arg *a = (struct thread_arg *)arg;
-	lflist_head_t *head = a->head;
-	int idx = a->idx;
-	int i;
+	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  insert(head, x.node, smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = harris_del(head, x.node, snip,
+							  smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  harris_find(head, x.node, snip,
+						      smr));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
+	}
+
+	insert_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i), smr));
+	}
+	find_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  harris_find(head, phase_node(i), snip, smr));
+	}
+	delete_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_DELETE,
+			  harris_del(head, phase_node(i), snip, smr));
+	}
 
-#define LEN (16000)
-	struct integer_entry *es = malloc(sizeof(*es) * LEN);
-	for (i = 0; i < LEN; ++i) {
-		es[i].x = i;
-		lflist_add(head, &es[i].integers);
-		lflist_del_harris(head, &es[i].integers);
+	all_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_FIND,
+			  harris_find(head, phase_node(i), snip, smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  harris_del(head, phase_node(i), snip, smr));
 	}
+	finish_find_phase_foreach()
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  harris_find(head, phase_node(rops), snip, smr));
+	}
+	finish_insdel_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  harris_del(head, phase_node(i), snip, smr));
+	}
+	smr_thread_stop(smr);
 	pthread_exit(NULL);
-#undef LEN
 }
 
-int main(void)
+void *harris_trfunc(void *varg)
 {
-	lflist_head_t head;
-	lflist_init(&head);
-	char buf[128];
-#define NTS (8)
-	pthread_t tids[NTS];
-	struct thread_arg args[NTS];
+	return harris_run(varg, false);
+}
 
-	struct pf_hw_timer timer;
+void *harris_search_trfunc(void *varg)
+{
+	return harris_run(varg, true);
+}
 
-	pf_hw_timer_start(&timer);
-	for (int i = 0; i < NTS; ++i) {
-		args[i].head = &head;
-		args[i].idx = i;
-		pthread_create(&tids[i], NULL, pthread_runner, &args[i]);
+void *harris_sorted_trfunc(void *varg)
+{
+	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  ok = sorted_insert(head, x.node, smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = sorted_remove(
+						  head, to_lfkey(x.node)->key,
+						  smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  sorted_contains(
+						  head, to_lfkey(x.node)->key,
+						  smr));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
 	}
 
-	for (int i = 0; i < NTS; ++i) {
-		pthread_join(tids[i], NULL);
+	insert_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sorted_insert(head, phase_node(i), smr));
+	}
+	find_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  sorted_contains(head, phase_key(i), smr));
+	}
+	delete_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_DELETE,
+			  sorted_remove(head, phase_key(i), smr));
 	}
-	pf_hw_timer_end(&timer, PF_TSC_FREQ_HZ_INTEL_12700K);
-
-	_integer_list_print(&head);
-
-	pf_timer_pretty_time(&timer.duration, PF_HW_TIMER_US, 2, buf, 128);
 
-	printf("%s\n", buf);
+	all_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sorted_insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_FIND,
+			  sorted_contains(head, phase_key(i), smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  sorted_remove(head, phase_key(i), smr));
+	}
+	finish_find_phase_foreach()
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  sorted_contains(head, phase_key(rops), smr));
+	}
+	finish_insdel_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sorted_insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  sorted_remove(head, phase_key(i), smr));
+	}
+	smr_thread_stop(smr);
+	pthread_exit(NULL);
+}
 
-	return 0;
+/* Only the deleter unlinks its target and it keeps trying until it has. With
+ * search() someone else may unlink it, but del doesn't return before then.
+ */
+void harris_cleanup(thr_arg_t *arg)
+{
+	(void)arg;
 }
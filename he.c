@@ -0,0 +1,175 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ck_pr.h>
+
+#include "he.h"
+#include "lf.h"
+
+static int he_cmp(const void *a, const void *b)
+{
+	uint64_t ua = *(const uint64_t *)a;
+	uint64_t ub = *(const uint64_t *)b;
+
+	return (ua > ub) - (ua < ub);
+}
+
+static void he_reclaim(he_tls_t *h, lfhead_t *node)
+{
+	he_domain_t *d = h->dom;
+
+	if (d->reclaim) {
+		d->reclaim(node, d->reclaim_ctx);
+	}
+	++h->reclaimed;
+}
+
+/* eras is sorted. Is any published era within [birth, retire]? */
+static int he_reserved(const uint64_t *eras, uint64_t num, lfhead_t *node)
+{
+	struct he_eras *e = he_eras(node);
+	uint64_t lo = 0, hi = num;
+
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+
+		if (eras[mid] < e->birth_era) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo < num && eras[lo] <= e->retire_era;
+}
+
+int he_domain_init(he_domain_t *d, he_tls_t *recs, uint64_t rec_num,
+		   lf_reclaim_fn reclaim, void *reclaim_ctx)
+{
+	uint64_t he_num = rec_num * HPS_MAX;
+
+	d->era = 1;
+	d->recs = recs;
+	d->rec_num = rec_num;
+	d->threshold = he_num * 2 > HP_SCAN_MIN ? he_num * 2 : HP_SCAN_MIN;
+	d->reclaim = reclaim;
+	d->reclaim_ctx = reclaim_ctx;
+	hp_membarrier_register();
+
+	for (uint64_t i = 0; i < rec_num; ++i) {
+		he_tls_t *h = &recs[i];
+
+		memset(h->eras, 0, sizeof(h->eras));
+		h->dom = d;
+		h->active = 0;
+		h->lines = 1;
+		h->rlist = NULL;
+		h->rnum = 0;
+		h->retires = 0;
+		h->reclaimed = 0;
+		h->scratch = malloc(sizeof(*h->scratch) * rec_num * HP_SLOTS);
+		if (!h->scratch) {
+			d->rec_num = i;
+			he_domain_destroy(d);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void he_domain_destroy(he_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		free(d->recs[i].scratch);
+		d->recs[i].scratch = NULL;
+	}
+}
+
+void he_domain_drain(he_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		he_tls_t *h = &d->recs[i];
+
+		while (h->rlist) {
+			lfhead_t *node = h->rlist;
+
+			h->rlist = node->next_ret;
+			he_reclaim(h, node);
+		}
+		h->rnum = 0;
+	}
+}
+
+void he_domain_stats(he_domain_t *d, uint64_t *reclaimed, uint64_t *pending)
+{
+	*reclaimed = 0;
+	*pending = 0;
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		*reclaimed += d->recs[i].reclaimed;
+		*pending += d->recs[i].rnum;
+	}
+}
+
+he_tls_t *he_register(he_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		he_tls_t *h = &d->recs[i];
+
+		if (ck_pr_load_uint(&h->active) == 0 &&
+		    ck_pr_cas_uint(&h->active, 0, 1)) {
+			return h;
+		}
+	}
+
+	return NULL;
+}
+
+void he_unregister(he_tls_t *h)
+{
+	memset(h->eras, 0, sizeof(h->eras));
+	ck_pr_store_uint(&h->lines, 1);
+	if (h->rnum > 0) {
+		he_scan(h);
+	}
+	ck_pr_store_uint(&h->active, 0);
+}
+
+void he_scan(he_tls_t *h)
+{
+	he_domain_t *d = h->dom;
+	uint64_t *elist = h->scratch;
+	uint64_t enr = 0;
+	lfhead_t *rlist, *node;
+
+	hp_heavy_fence();
+
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		he_tls_t *r = &d->recs[i];
+		uint64_t n = ck_pr_load_uint(&r->lines) * HPS_MAX;
+
+		for (uint64_t j = 0; j < n; ++j) {
+			uint64_t era = ck_pr_load_64(&r->eras[j]);
+			if (era != HE_ERA_NONE) {
+				elist[enr++] = era;
+			}
+		}
+	}
+	qsort(elist, enr, sizeof(*elist), he_cmp);
+
+	rlist = h->rlist;
+	h->rlist = NULL;
+	h->rnum = 0;
+	while (rlist) {
+		node = rlist;
+		rlist = node->next_ret;
+		if (he_reserved(elist, enr, node)) {
+			node->next_ret = h->rlist;
+			h->rlist = node;
+			++h->rnum;
+		} else {
+			he_reclaim(h, node);
+		}
+	}
+}
@@ -0,0 +1,148 @@
+#ifndef HE_H
+#define HE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "lf.h"
+
+/* Hazard eras (Ramalhete & Correia). Nodes record the era they were linked
+ * in (birth_era) and the era they were retired in (retire_era). Readers
+ * publish an era per slot instead of a pointer; a retired node is only kept
+ * while some published era falls within [birth_era, retire_era]. Since the
+ * era moves rarely, most hops just compare it against the published one and
+ * skip the store and fence a hazard pointer needs.
+ *
+ * The eras live in the 16 bytes right before the node, so whoever owns node
+ * memory leaves that room in front of every node retired through he.
+ */
+
+/* Published eras start at 1, 0 means the slot is empty */
+#define HE_ERA_NONE (0)
+/* Retires per thread between era advances */
+#define HE_ERA_FREQ (64)
+
+struct he_domain;
+
+struct he_eras {
+	uint64_t birth_era;
+	uint64_t retire_era;
+};
+
+inline static struct he_eras *he_eras(lfhead_t *node)
+{
+	return (struct he_eras *)(void *)node - 1;
+}
+
+struct he_tls {
+	uint64_t eras[HP_SLOTS];
+	/* Owner only, same split as hp_tls */
+	struct he_domain *dom __attribute__((aligned(CACHELINE_BYTES)));
+	unsigned int active;
+	unsigned int lines;
+	struct lfhead *rlist;
+	uint64_t rnum;
+	uint64_t retires;
+	uint64_t reclaimed;
+	uint64_t *scratch;
+} __attribute__((aligned(CACHELINE_BYTES)));
+typedef struct he_tls he_tls_t;
+
+struct he_domain {
+	uint64_t era __attribute__((aligned(CACHELINE_BYTES)));
+	he_tls_t *recs __attribute__((aligned(CACHELINE_BYTES)));
+	uint64_t rec_num;
+	uint64_t threshold;
+	lf_reclaim_fn reclaim;
+	void *reclaim_ctx;
+};
+typedef struct he_domain he_domain_t;
+
+/* Same contract as hp_domain_init */
+int he_domain_init(he_domain_t *d, he_tls_t *recs, uint64_t rec_num,
+		   lf_reclaim_fn reclaim, void *reclaim_ctx);
+void he_domain_destroy(he_domain_t *d);
+void he_domain_drain(he_domain_t *d);
+void he_domain_stats(he_domain_t *d, uint64_t *reclaimed, uint64_t *pending);
+
+he_tls_t *he_register(he_domain_t *d);
+void he_unregister(he_tls_t *h);
+void he_scan(he_tls_t *h);
+
+inline static void he_clear(he_tls_t *h)
+{
+	/* Only use 3 entries for now, like hp_clear */
+	ck_pr_store_64(&h->eras[0], HE_ERA_NONE);
+	ck_pr_store_64(&h->eras[1], HE_ERA_NONE);
+	ck_pr_store_64(&h->eras[2], HE_ERA_NONE);
+}
+
+inline static void he_clear_slots(he_tls_t *h, uint64_t from, uint64_t to)
+{
+	for (uint64_t i = from; i < to; ++i) {
+		ck_pr_store_64(&h->eras[i], HE_ERA_NONE);
+	}
+}
+
+/* Same as hp_reserve */
+inline static void he_reserve(he_tls_t *h, uint64_t n)
+{
+	unsigned int lines = (unsigned int)((n + HPS_MAX - 1) / HPS_MAX);
+
+	if (lines > h->lines) {
+		ck_pr_store_uint(&h->lines, lines);
+	}
+}
+
+/* Must be called before node becomes reachable */
+inline static void he_birth(he_tls_t *h, lfhead_t *node)
+{
+	he_eras(node)->birth_era = ck_pr_load_64(&h->dom->era);
+}
+
+inline static void he_inherit(he_tls_t *h, uint64_t from, uint64_t to)
+{
+	uint64_t era = h->eras[from];
+
+	if (h->eras[to] != era) {
+		ck_pr_store_64(&h->eras[to], era);
+	}
+}
+
+inline static lfhead_t *he_protect(he_tls_t *h, lfhead_t **src_ptr, uint64_t n)
+{
+	uint64_t prev = h->eras[n];
+	uint64_t era;
+	lfhead_t *val;
+
+	while (1) {
+		val = ck_pr_load_ptr(src_ptr);
+		era = ck_pr_load_64(&h->dom->era);
+		/* Anything val could be was alive in an era we already publish */
+		if (era == prev) {
+			return val;
+		}
+		ck_pr_store_64(&h->eras[n], era);
+		hp_local_fence();
+		prev = era;
+	}
+}
+
+inline static void he_retire(he_tls_t *h, lfhead_t *tar)
+{
+	he_domain_t *d = h->dom;
+
+	he_eras(tar)->retire_era = ck_pr_load_64(&d->era);
+	tar->next_ret = h->rlist;
+	h->rlist = tar;
+	if (++h->retires % HE_ERA_FREQ == 0) {
+		ck_pr_inc_64(&d->era);
+	}
+	if (++h->rnum >= d->threshold) {
+		he_scan(h);
+	}
+}
+
+#endif /* HE_H */
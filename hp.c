@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+
+#include <linux/membarrier.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <ck_pr.h>
+
+#include "lf.h"
+
+int hp_membarrier = 0;
+
+static int membarrier(int cmd, unsigned int flags)
+{
+	return (int)syscall(__NR_membarrier, cmd, flags, 0);
+}
+
+/* Process wide, so registering once is enough for every domain */
+void hp_membarrier_register(void)
+{
+	int cmds;
+
+	if (hp_membarrier) {
+		return;
+	}
+	cmds = membarrier(MEMBARRIER_CMD_QUERY, 0);
+	if (cmds < 0 || !(cmds & MEMBARRIER_CMD_PRIVATE_EXPEDITED)) {
+		return;
+	}
+	if (membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0) {
+		hp_membarrier = 1;
+	}
+}
+
+void hp_heavy_fence(void)
+{
+	if (hp_membarrier) {
+		/* Readers skipped their fence, there is no way to recover */
+		if (membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) != 0) {
+			abort();
+		}
+	} else {
+		ck_pr_fence_memory();
+	}
+}
+
+static int hp_cmp(const void *a, const void *b)
+{
+	uintptr_t ua = (uintptr_t)*(lfhead_t *const *)a;
+	uintptr_t ub = (uintptr_t)*(lfhead_t *const *)b;
+
+	return (ua > ub) - (ua < ub);
+}
+
+static void hp_reclaim(hp_tls_t *h, lfhead_t *node)
+{
+	hp_domain_t *d = h->dom;
+
+	if (d->reclaim) {
+		d->reclaim(node, d->reclaim_ctx);
+	}
+	++h->reclaimed;
+}
+
+int hp_domain_init(hp_domain_t *d, hp_tls_t *recs, uint64_t rec_num,
+		   lf_reclaim_fn reclaim, void *reclaim_ctx)
+{
+	/* Sized for the lists, scratch for every slot that could be posted */
+	uint64_t hp_num = rec_num * HPS_MAX;
+
+	d->recs = recs;
+	d->rec_num = rec_num;
+	d->threshold = hp_num * 2 > HP_SCAN_MIN ? hp_num * 2 : HP_SCAN_MIN;
+	d->reclaim = reclaim;
+	d->reclaim_ctx = reclaim_ctx;
+	hp_membarrier_register();
+
+	for (uint64_t i = 0; i < rec_num; ++i) {
+		hp_tls_t *h = &recs[i];
+
+		memset(h->hps, 0, sizeof(h->hps));
+		h->dom = d;
+		h->active = 0;
+		h->lines = 1;
+		h->rlist = NULL;
+		h->rnum = 0;
+		h->reclaimed = 0;
+		h->scratch = malloc(sizeof(*h->scratch) * rec_num * HP_SLOTS);
+		if (!h->scratch) {
+			d->rec_num = i;
+			hp_domain_destroy(d);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void hp_domain_destroy(hp_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		free(d->recs[i].scratch);
+		d->recs[i].scratch = NULL;
+	}
+}
+
+void hp_domain_drain(hp_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		hp_tls_t *h = &d->recs[i];
+
+		while (h->rlist) {
+			lfhead_t *node = h->rlist;
+
+			h->rlist = node->next_ret;
+			hp_reclaim(h, node);
+		}
+		h->rnum = 0;
+	}
+}
+
+void hp_domain_stats(hp_domain_t *d, uint64_t *reclaimed, uint64_t *pending)
+{
+	*reclaimed = 0;
+	*pending = 0;
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		*reclaimed += d->recs[i].reclaimed;
+		*pending += d->recs[i].rnum;
+	}
+}
+
+hp_tls_t *hp_register(hp_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		hp_tls_t *h = &d->recs[i];
+
+		if (ck_pr_load_uint(&h->active) == 0 &&
+		    ck_pr_cas_uint(&h->active, 0, 1)) {
+			return h;
+		}
+	}
+
+	return NULL;
+}
+
+/* Retired nodes that are still hazardous stay on the record and are picked
+ * up by whichever thread registers it next.
+ */
+void hp_unregister(hp_tls_t *h)
+{
+	memset(h->hps, 0, sizeof(h->hps));
+	ck_pr_store_uint(&h->lines, 1);
+	if (h->rnum > 0) {
+		hp_scan(h);
+	}
+	ck_pr_store_uint(&h->active, 0);
+}
+
+void hp_scan(hp_tls_t *h)
+{
+	hp_domain_t *d = h->dom;
+	lfhead_t **plist = h->scratch;
+	uint64_t pnum = 0;
+	lfhead_t *rlist, *node;
+
+	/* Retired nodes were unlinked before this point. Order that against
+	 * the hazard loads below, and (with membarrier) every reader's hazard
+	 * store against its validating reload.
+	 */
+	hp_heavy_fence();
+
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		hp_tls_t *r = &d->recs[i];
+		uint64_t n = ck_pr_load_uint(&r->lines) * HPS_MAX;
+
+		for (uint64_t j = 0; j < n; ++j) {
+			uintptr_t hp = (uintptr_t)ck_pr_load_ptr(&r->hps[j]);
+			if (hp & HP_PTR_MASK) {
+				plist[pnum++] = (lfhead_t *)(hp & HP_PTR_MASK);
+			}
+		}
+	}
+	qsort(plist, pnum, sizeof(*plist), hp_cmp);
+
+	rlist = h->rlist;
+	h->rlist = NULL;
+	h->rnum = 0;
+	while (rlist) {
+		node = rlist;
+		rlist = node->next_ret;
+		if (bsearch(&node, plist, pnum, sizeof(*plist), hp_cmp)) {
+			node->next_ret = h->rlist;
+			h->rlist = node;
+			++h->rnum;
+		} else {
+			hp_reclaim(h, node);
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lat.h"
+
+static const char *const lat_names[] = {
+	[LAT_INSERT] = "insert",
+	[LAT_FIND] = "find",
+	[LAT_DELETE] = "delete",
+};
+
+const char *lat_op_name(enum lat_op op)
+{
+	return lat_names[op];
+}
+
+void lat_reset(lat_tls_t *l)
+{
+	memset(l, 0, sizeof(*l));
+}
+
+void lat_merge(lat_tls_t *dst, const lat_tls_t *src)
+{
+	for (int op = 0; op < LAT_OP_NUM; ++op) {
+		struct lat_hist *d = &dst->ops[op];
+		const struct lat_hist *s = &src->ops[op];
+
+		for (int b = 0; b < LAT_BUCKETS; ++b) {
+			d->counts[b] += s->counts[b];
+		}
+		d->num += s->num;
+		d->max = s->max > d->max ? s->max : d->max;
+	}
+}
+
+static uint64_t lat_bucket_max(unsigned int b)
+{
+	unsigned int shift;
+	uint64_t sub;
+
+	if (b < LAT_SUB) {
+		return b;
+	}
+	shift = b / LAT_SUB - 1;
+	sub = b % LAT_SUB;
+	return (((LAT_SUB | sub) + 1) << shift) - 1;
+}
+
+uint64_t lat_quantile(const struct lat_hist *h, double q)
+{
+	uint64_t rank = (uint64_t)(q * (double)h->num + 0.5);
+	uint64_t seen = 0;
+
+	if (rank == 0) {
+		rank = 1;
+	}
+	for (unsigned int b = 0; b < LAT_BUCKETS; ++b) {
+		seen += h->counts[b];
+		if (seen >= rank) {
+			uint64_t v = lat_bucket_max(b);
+			return v < h->max ? v : h->max;
+		}
+	}
+	return h->max;
+}
@@ -0,0 +1,110 @@
+#ifndef LAT_H
+#define LAT_H
+
+#include <stdint.h>
+
+#include "lf.h"
+
+/* Per-operation latency recording in the bench. Build with
+ * -DBENCH_LATENCY=0 to compile the rdtsc pairs out of the trfuncs.
+ */
+#ifndef BENCH_LATENCY
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_LATENCY (1)
+#else
+#define BENCH_LATENCY (0)
+#endif
+#endif
+
+#if BENCH_LATENCY
+#include <x86intrin.h>
+#endif
+
+enum lat_op {
+	LAT_INSERT,
+	LAT_FIND,
+	LAT_DELETE,
+	LAT_OP_NUM,
+};
+
+/* Log-linear buckets: values below LAT_SUB are exact, above that every power
+ * of two is split into LAT_SUB buckets, so a bucket is within 1/LAT_SUB of
+ * any value it holds.
+ */
+#define LAT_SUB_BITS (4)
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_BUCKETS ((64 - LAT_SUB_BITS + 1) * LAT_SUB)
+
+struct lat_hist {
+	uint64_t num;
+	uint64_t max;
+	uint64_t counts[LAT_BUCKETS];
+};
+
+/* Only the owning thread writes it, merged after join */
+struct lat_tls {
+	/* Ops seen, see LAT_TIMED */
+	uint64_t seq;
+	struct lat_hist ops[LAT_OP_NUM];
+} __attribute__((aligned(CACHELINE_BYTES)));
+typedef struct lat_tls lat_tls_t;
+
+inline static unsigned int lat_bucket(uint64_t v)
+{
+	unsigned int msb, shift;
+
+	if (v < LAT_SUB) {
+		return (unsigned int)v;
+	}
+	msb = 63 - (unsigned int)__builtin_clzll(v);
+	shift = msb - LAT_SUB_BITS;
+	return (shift + 1) * LAT_SUB +
+	       (unsigned int)((v >> shift) & (LAT_SUB - 1));
+}
+
+inline static void lat_record(lat_tls_t *l, enum lat_op op, uint64_t cycles)
+{
+	struct lat_hist *h = &l->ops[op];
+
+	++h->counts[lat_bucket(cycles)];
+	++h->num;
+	if (cycles > h->max) {
+		h->max = cycles;
+	}
+}
+
+/* rdtsc costs about as much as a short list operation, so only one op in
+ * BENCH_LATENCY_SAMPLE (a power of two) is timed. Sampling is uniform, so
+ * quantiles stay unbiased; build with -DBENCH_LATENCY_SAMPLE=1 to time
+ * every op.
+ */
+#ifndef BENCH_LATENCY_SAMPLE
+#define BENCH_LATENCY_SAMPLE (32)
+#endif
+
+#if BENCH_LATENCY
+#define LAT_TIMED(lat, op, call)                                          \
+	do {                                                              \
+		if (((lat)->seq++ & (BENCH_LATENCY_SAMPLE - 1)) == 0) {   \
+			uint64_t lat_t0_ = __rdtsc();                     \
+			call;                                             \
+			lat_record((lat), (op), __rdtsc() - lat_t0_);     \
+		} else {                                          \
+			call;                                     \
+		}                                                 \
+	} while (0)
+#else
+#define LAT_TIMED(lat, op, call) \
+	do {                     \
+		(void)(lat);     \
+		call;            \
+	} while (0)
+#endif
+
+const char *lat_op_name(enum lat_op op);
+void lat_reset(lat_tls_t *l);
+void lat_merge(lat_tls_t *dst, const lat_tls_t *src);
+/* Upper bound of the bucket holding quantile q (0 < q <= 1), in cycles */
+uint64_t lat_quantile(const struct lat_hist *h, double q);
+
+#endif /* LAT_H */
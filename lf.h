@@ -1,48 +1,216 @@
 #ifndef LF_H
 #define LF_H
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <ck_pr.h>
 
 #define CACHELINE_BYTES (64)
+
+#include "ctr.h"
+#include "cm.h"
+
+/* Hazard slots per cache line. The lists only use the first line; a skip
+ * list protects two nodes per level of the tower it inserts, so records have
+ * HP_LINES of them and only expose the ones a thread reserved.
+ */
 #define HPS_MAX (CACHELINE_BYTES / sizeof(void *))
+#define HP_LINES (6)
+#define HP_SLOTS (HPS_MAX * HP_LINES)
 
+/* 16 byte aligned so next and next_ret can be swapped with one DWCAS.
+ * Lists that need more per node embed it first in their own node below and
+ * get back to that with lflist_entry. Hazard eras keep theirs right in
+ * front of the node (he.h).
+ */
 struct lfhead {
 	struct lfhead *next;
 	struct lfhead *next_ret;
-};
+} __attribute__((aligned(16)));
 typedef struct lfhead lfhead_t;
 typedef void lfhead_unsafe_t;
 
+#define lflist_entry(lflist_head_ptr, entry_type, entry_lflist_head_member) \
+	((entry_type *)((uintptr_t)(lflist_head_ptr) -                      \
+			offsetof(entry_type, entry_lflist_head_member)))
+
+/* Sorted lists: harris_sorted, michael_sorted and so */
+struct lfkey {
+	lfhead_t head;
+	uint64_t key;
+};
+
+inline static struct lfkey *to_lfkey(lfhead_t *node)
+{
+	return lflist_entry(node, struct lfkey, head);
+}
+
+/* Skip list, tower holds the levels above 0 (sl.c) */
+struct lf_tower;
+struct sl_node {
+	struct lfkey k;
+	struct lf_tower *tower;
+};
+
+inline static struct sl_node *to_sl_node(lfhead_t *node)
+{
+	return lflist_entry(node, struct sl_node, k.head);
+}
+
+/* Doubly linked list, see dll.c for prev and linked */
+struct dll_node {
+	lfhead_t head;
+	struct lfhead *prev;
+	uint64_t linked;
+};
+
+inline static struct dll_node *to_dll_node(lfhead_t *node)
+{
+	return lflist_entry(node, struct dll_node, head);
+}
+
+/* Zhang's entries and dummies. linked tells them apart, prev links the
+ * dummy ring and tid is the enlisting thread (zhang_wf), see zhang.c.
+ */
+struct zhang_node {
+	lfhead_t head;
+	struct lfhead *prev;
+	uint64_t linked;
+	uint64_t tid;
+};
+
+inline static struct zhang_node *to_zhang_node(lfhead_t *node)
+{
+	return lflist_entry(node, struct zhang_node, head);
+}
+
+/* Sorted lists keep keys ascending by LF_KEY_CMP(a, b), which is <0, 0 or >0
+ * like memcmp. Define it before including lf.h to specialize the ordering.
+ */
+#ifndef LF_KEY_CMP
+#define LF_KEY_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+#endif
+
+/* Deleted nodes have their next pointer marked (Harris, Michael, skip list) */
+#define PTR_MARK ((uintptr_t)1)
+
+inline static bool is_marked(void *ptr)
+{
+	uintptr_t uptr = (uintptr_t)ptr;
+	return uptr & PTR_MARK;
+}
+
+inline static bool is_unmarked(void *ptr)
+{
+	return !is_marked(ptr);
+}
+
+inline static lfhead_unsafe_t *mark(void *ptr)
+{
+	uintptr_t uptr = (uintptr_t)ptr;
+	return (lfhead_unsafe_t *)(uptr | PTR_MARK);
+}
+
+inline static lfhead_t *unmark(void *ptr)
+{
+	uintptr_t uptr = (uintptr_t)ptr;
+	return (lfhead_t *)(uptr & ~PTR_MARK);
+}
+
+/* Called for every node a reclamation scheme decides is safe to reuse. */
+typedef void (*lf_reclaim_fn)(lfhead_t *node, void *ctx);
+
+struct hp_domain;
+
 struct hp_tls {
-	struct lfhead *hps[HPS_MAX];
+	struct lfhead *hps[HP_SLOTS];
+	/* Everything below is only touched by the owning thread (or by
+	 * hp_domain_* while no thread is registered). It starts on its own
+	 * cache line so scanners reading hps don't bounce it.
+	 */
+	struct hp_domain *dom __attribute__((aligned(CACHELINE_BYTES)));
+	unsigned int active;
+	/* Lines of hps in use, only grows while registered. Scanners read
+	 * it too, but only once per scan.
+	 */
+	unsigned int lines;
+	struct lfhead *rlist;
+	uint64_t rnum;
+	uint64_t reclaimed;
+	struct lfhead **scratch;
 } __attribute__((aligned(CACHELINE_BYTES)));
 typedef struct hp_tls hp_tls_t;
 
+struct hp_domain {
+	hp_tls_t *recs;
+	uint64_t rec_num;
+	/* Retired nodes per thread before a scan is attempted */
+	uint64_t threshold;
+	lf_reclaim_fn reclaim;
+	void *reclaim_ctx;
+};
+typedef struct hp_domain hp_domain_t;
+
+#define HP_SCAN_MIN (64)
+/* Hazards may be posted with mark bits set (Harris/Michael) */
+#define HP_PTR_MASK (~((uintptr_t)sizeof(void *) - 1))
+
 #define HP_PREV (2)
 #define HP_CURR (1)
 #define HP_NEXT (0)
 
+/* Set once by hp_domain_init when the kernel supports private expedited
+ * membarrier(). hp_scan then forces a full fence on every running thread
+ * before reading hazards, so posting one only needs a compiler barrier.
+ */
+extern int hp_membarrier;
+
+void hp_membarrier_register(void);
+/* Pairs with hp_local_fence() in readers; called before reading hazards */
+void hp_heavy_fence(void);
+
 inline static void hp_local_fence(void)
 {
-	// Full fence not required if using membarier() on consumer
-	// ck_pr_fence_memory();
-	ck_pr_barrier();
+	if (hp_membarrier) {
+		ck_pr_barrier();
+	} else {
+		ck_pr_fence_memory();
+	}
 }
 
 inline static void hp_clear(hp_tls_t *h)
 {
 	/* Only use 3 entries for now */
-	h->hps[0] = NULL;
-	h->hps[1] = NULL;
-	h->hps[2] = NULL;
+	ck_pr_store_ptr(&h->hps[0], NULL);
+	ck_pr_store_ptr(&h->hps[1], NULL);
+	ck_pr_store_ptr(&h->hps[2], NULL);
+}
+
+inline static void hp_clear_slots(hp_tls_t *h, uint64_t from, uint64_t to)
+{
+	for (uint64_t i = from; i < to; ++i) {
+		ck_pr_store_ptr(&h->hps[i], NULL);
+	}
+}
+
+/* Exposes slots [0, n) to scanners. Must come before any of them is posted;
+ * posting fences, so it is ordered before the hazard is validated.
+ */
+inline static void hp_reserve(hp_tls_t *h, uint64_t n)
+{
+	unsigned int lines = (unsigned int)((n + HPS_MAX - 1) / HPS_MAX);
+
+	if (lines > h->lines) {
+		ck_pr_store_uint(&h->lines, lines);
+	}
 }
 
 /* from <= to */
 inline static void hp_inherit(hp_tls_t *h, uint64_t from, uint64_t to)
 {
-	h->hps[to] = h->hps[from];
+	ck_pr_store_ptr(&h->hps[to], h->hps[from]);
 	hp_local_fence();
 }
 
@@ -53,7 +221,7 @@ inline static lfhead_t *hp_post(hp_tls_t *h, lfhead_t **src_ptr, uint64_t n)
 	while (1) {
 		/* Relaxed load target and relaxed store hp */
 		val = ck_pr_load_ptr(src_ptr);
-		h->hps[n] = val;
+		ck_pr_store_ptr(&h->hps[n], val);
 		/* Make sure hp is visible */
 		hp_local_fence();
 		/* Check if target changed between load and store
@@ -62,18 +230,50 @@ inline static lfhead_t *hp_post(hp_tls_t *h, lfhead_t **src_ptr, uint64_t n)
 		if (ck_pr_load_ptr(src_ptr) == val) {
 			return val;
 		} else {
+			CTR_INC(CTR_HP_REPOST);
 			continue;
 		}
 	}
 }
 
+/* Records are caller provided so they can live in static storage. A NULL
+ * reclaim means the caller owns node memory; reclaimed nodes are only
+ * counted. Returns -1 if scan scratch space couldn't be allocated.
+ * Must be called before any thread posts a hazard.
+ */
+int hp_domain_init(hp_domain_t *d, hp_tls_t *recs, uint64_t rec_num,
+		   lf_reclaim_fn reclaim, void *reclaim_ctx);
+void hp_domain_destroy(hp_domain_t *d);
+/* Only safe when no thread is registered. Reclaims every pending node. */
+void hp_domain_drain(hp_domain_t *d);
+void hp_domain_stats(hp_domain_t *d, uint64_t *reclaimed, uint64_t *pending);
+
+hp_tls_t *hp_register(hp_domain_t *d);
+void hp_unregister(hp_tls_t *h);
+void hp_scan(hp_tls_t *h);
+
+/* tar must already be unlinked. It is reclaimed once no record posts it. */
+inline static void hp_retire(hp_tls_t *h, lfhead_t *tar)
+{
+	tar->next_ret = h->rlist;
+	h->rlist = tar;
+	if (++h->rnum >= h->dom->threshold) {
+		hp_scan(h);
+	}
+}
+
 /* HP retire list will be a Treiber stack. MPSC */
 inline static void retire_push(lfhead_t *rhead, lfhead_t *tar)
 {
 	lfhead_t *old = ck_pr_load_ptr(&rhead->next_ret);
-	do {
+	cm_t b = CM_INITIALIZER;
+
+	tar->next_ret = old;
+	while (!ctr_cas(ck_pr_cas_ptr_value(&rhead->next_ret, old, tar,
+					    &old))) {
+		cm_fail(&b);
 		tar->next_ret = old;
-	} while (!ck_pr_cas_ptr_value(&rhead->next_ret, old, tar, &old));
+	}
 }
 inline static lfhead_t *retire_pop(lfhead_t *rhead)
 {
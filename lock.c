@@ -29,6 +29,7 @@ inline static bool del(lfhead_t *restrict head, lfhead_t *restrict target)
 	lfhead_t *prev = head;
 	lfhead_t *curr = head->next;
 	while (curr != head) {
+		CTR_INC(CTR_TRAVERSE);
 		if (curr == target) {
 			prev->next = curr->next;
 			pthread_mutex_unlock(&lock);
@@ -47,6 +48,7 @@ inline static bool find(lfhead_t *restrict head, lfhead_t *restrict target)
 	lfhead_t *prev = head;
 	lfhead_t *curr = head->next;
 	while (curr != head) {
+		CTR_INC(CTR_TRAVERSE);
 		if (curr == target) {
 			pthread_mutex_unlock(&lock);
 			return true;
@@ -61,42 +63,76 @@ inline static bool find(lfhead_t *restrict head, lfhead_t *restrict target)
 void *lock_trfunc(void *varg)
 {
 	BENCH_DECOMPOSE_ARGS(varg);
+	bool deleted;
+
+	if (wl) {
+		/* Deleted nodes are handed back directly, see wl.direct_free */
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT, insert(head, x.node));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE, ok = del(head, x.node));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  find(head, x.node));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		pthread_exit(NULL);
+	}
+
 	insert_phase_foreach(i)
 	{
-		insert(head, &nodes[i]);
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i)));
 	}
 	find_phase_foreach(i)
 	{
-		find(head, &nodes[i]);
+		LAT_TIMED(lat, LAT_FIND, find(head, phase_node(i)));
 	}
 	delete_phase_foreach(i)
 	{
-		if (del(head, &nodes[i])) {
+		LAT_TIMED(lat, LAT_DELETE, deleted = del(head, phase_node(i)));
+		if (deleted) {
 			/* We don't really have to do this because we could just free() it
 			 * here, but the benchmark checks for correctness by popping from
 			 * this.
 			 */
-			retire_push(head_ret, &nodes[i]);
+			retire_push(head_ret, phase_node(i));
 		}
 	}
 
 	all_phase_foreach(i)
 	{
-		insert(head, &nodes[i]);
-		find(head, &nodes[i]);
-		if (del(head, &nodes[i])) {
-			retire_push(head_ret, &nodes[i]);
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i)));
+		LAT_TIMED(lat, LAT_FIND, find(head, phase_node(i)));
+		LAT_TIMED(lat, LAT_DELETE, deleted = del(head, phase_node(i)));
+		if (deleted) {
+			retire_push(head_ret, phase_node(i));
 		}
 	}
 	finish_find_phase_foreach()
 	{
-		find(head, &nodes[rops]);
+		LAT_TIMED(lat, LAT_FIND, find(head, phase_node(rops)));
 	}
 	finish_insdel_phase_foreach(i)
 	{
-		insert(head, &nodes[i]);
-		if (del(head, &nodes[i])) {
-			retire_push(head_ret, &nodes[i]);
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i)));
+		LAT_TIMED(lat, LAT_DELETE, deleted = del(head, phase_node(i)));
+		if (deleted) {
+			retire_push(head_ret, phase_node(i));
 		}
 	}
 	pthread_exit(NULL);
@@ -9,151 +9,42 @@
 
 #include <pf_hw_timer.h>
 
-#define NUM_THREADS (8)
-#define OPS_PER_THREAD (16000)
-#define HP_PER_THREAD (3)
+#include "bench.h"
+#include "lf.h"
+#include "michael.h"
+#include "smr.h"
 
-struct lflist_head {
-	struct lflist_head *next;
-	struct lflist_head *retired_next;
-};
-typedef struct lflist_head lflist_head_t;
-typedef void lflist_head_unsafe_t;
-
-struct integer_entry {
-	lflist_head_t integers;
-	int x;
-};
-
-struct hp_t {
-	struct lflist_head *hps[HP_PER_THREAD];
-} __attribute__((aligned(64)));
-
-#define PTR_MARK ((uintptr_t)1)
-
-inline static bool is_marked(void *ptr)
-{
-	uintptr_t uptr = (uintptr_t)ptr;
-	return uptr & PTR_MARK;
-}
-
-inline static bool is_unmarked(void *ptr)
-{
-	return !is_marked(ptr);
-}
-
-inline static lflist_head_unsafe_t *mark(void *ptr)
-{
-	uintptr_t uptr = (uintptr_t)ptr;
-	return (lflist_head_unsafe_t *)(uptr | PTR_MARK);
-}
-
-inline static lflist_head_t *unmark(void *ptr)
-{
-	uintptr_t uptr = (uintptr_t)ptr;
-	return (lflist_head_t *)(uptr & ~PTR_MARK);
-}
-
-#define LFLIST_END(head_ptr, curr_ptr) (head_ptr == unmark(curr_ptr))
-
-#define lflist_entry(lflist_head_ptr, entry_type, entry_lflist_head_member) \
-	((entry_type *)((uintptr_t)(lflist_head_ptr) -                      \
-			offsetof(entry_type, entry_lflist_head_member)))
-
-static lflist_head_t head;
-static lflist_head_t retired_head;
-static pthread_t tids[NUM_THREADS];
-static struct hp_t hps[NUM_THREADS];
-
-inline static void hp_reader_barrier(void)
-{
-	// ck_pr_fence_memory();
-	ck_pr_barrier();
-}
-
-inline static void hp_clear(uint64_t tidx)
-{
-	hps[tidx].hps[0] = NULL;
-	hps[tidx].hps[1] = NULL;
-	hps[tidx].hps[2] = NULL;
-}
-
-inline static void hp_inherit(uint64_t tidx, uint64_t from, uint64_t to)
-{
-	hps[tidx].hps[to] = hps[tidx].hps[from];
-	hp_reader_barrier();
-}
-
-inline static struct lflist_head *hp_post(struct lflist_head **t, uint64_t tidx,
-					  uint64_t hp_num)
-{
-	struct lflist_head *val;
-
-	(void)tidx;
-	(void)hp_num;
-
-	while (1) {
-		/* Relaxed load target and relaxed store hp */
-		val = *t;
-		hps[tidx].hps[hp_num] = val;
-		/* Make sure hp is visible */
-		hp_reader_barrier();
-		/* Check if target changed between load and store
-		 * This retries if so.
-		 */
-		if (*t == val) {
-			return val;
-		} else {
-			continue;
-		}
-	}
-}
-
-inline static void retire_push(struct lflist_head *t)
-{
-	struct lflist_head *old = retired_head.retired_next;
-	do {
-		t->retired_next = old;
-	} while (
-		!ck_pr_cas_ptr_value(&retired_head.retired_next, old, t, &old));
-}
-
-inline static struct lflist_head *retire_pop(void)
-{
-	struct lflist_head *old = retired_head.retired_next;
-	while (!ck_pr_cas_ptr_value(&retired_head.retired_next, old,
-				    old->retired_next, &old))
-		;
-	return old;
-}
-
-inline static bool find(struct lflist_head *t, uint64_t tidx,
-			struct lflist_head **pnext, struct lflist_head **pcurr,
-			struct lflist_head **pprev)
+inline static bool search(lfhead_t *head, lfhead_t *t, smr_tls_t *smr,
+			  lfhead_t **pnext, lfhead_t **pcurr, lfhead_t **pprev)
 {
 	/* HP requires inheriting pointers to have a greater index than the
 	 * value they are inheriting from. curr inherits from next and prev
 	 * inherits from curr.
 	 */
-	struct lflist_head *next, *curr, *prev;
-	struct lflist_head *nexts, *currs, *prevs;
+	lfhead_t *next, *curr, *prev;
+	lfhead_t *nexts, *currs, *prevs;
 try_again:
-	prev = &head;
-	curr = hp_post(&head.next, tidx, 1); /* Mark curr as hp1 */
+	prev = head;
+	curr = smr_protect(smr, &head->next, 1); /* Mark curr as hp1 */
 	while (1) {
 		prevs = unmark(prev);
 		currs = unmark(curr);
-		next = hp_post(&currs->next, tidx, 0); /* Mark next as hp0 */
-		if (currs == &head) {
+		next = smr_protect(smr, &currs->next, 0); /* Mark next as hp0 */
+		if (currs == head) {
 			*pprev = prev;
 			*pcurr = curr;
 			*pnext = next;
 			return false;
 		}
-		if (currs->next != next)
+		CTR_INC(CTR_TRAVERSE);
+		if (currs->next != next) {
+			CTR_INC(CTR_RESTART_VALIDATE);
 			goto try_again;
-		if (prevs->next != curr)
+		}
+		if (prevs->next != curr) {
+			CTR_INC(CTR_RESTART_VALIDATE);
 			goto try_again;
+		}
 		if (is_unmarked(next)) {
 			if (t == currs) {
 				*pprev = prev;
@@ -162,142 +53,276 @@ try_again:
 				return true;
 			}
 			prev = curr;
-			hp_inherit(tidx, 1, 2);
+			smr_inherit(smr, 1, 2);
 		} else {
-			if (ck_pr_cas_ptr(&prevs->next, unmark(curr),
-					  unmark(next))) {
-				retire_push(currs);
+			CTR_INC(CTR_SKIP);
+			if (ctr_cas(ck_pr_cas_ptr(&prevs->next, unmark(curr),
+						  unmark(next)))) {
+				smr_retire(smr, currs);
 			} else {
+				CTR_INC(CTR_RESTART_CAS);
 				goto try_again;
 			}
 		}
 		curr = next;
-		hp_inherit(tidx, 0, 1);
+		smr_inherit(smr, 0, 1);
 	}
 }
 
-inline static bool insert(struct lflist_head *new, uint64_t tidx)
+inline static bool insert(lfhead_t *head, lfhead_t *new, smr_tls_t *smr)
 {
 	bool result;
+	lfhead_t *next;
+	cm_t b = CM_INITIALIZER;
 
-	(void)tidx;
-
+	smr_begin(smr);
+	smr_birth(smr, new);
+	next = ck_pr_load_ptr(&head->next);
 	while (1) {
-		new->next = head.next;
-		if (ck_pr_cas_ptr(&head.next, new->next, new)) {
+		new->next = next;
+		if (ctr_cas(ck_pr_cas_ptr_value(&head->next, next, new,
+						&next))) {
 			result = true;
 			break;
 		}
+		cm_fail(&b);
 	}
-	hp_clear(tidx);
+	smr_end(smr);
 	return result;
 }
 
-inline static bool delete(struct lflist_head *target, uint64_t tidx)
+inline static bool delete(lfhead_t *head, lfhead_t *target, smr_tls_t *smr)
 {
 	bool result;
-	struct lflist_head *next, *curr, *prev;
-	struct lflist_head *nexts, *currs, *prevs;
+	lfhead_t *next, *curr, *prev;
+	lfhead_t *nexts, *currs, *prevs;
 
+	smr_begin(smr);
 	while (1) {
-		if (!find(target, tidx, &next, &curr, &prev)) {
+		if (!search(head, target, smr, &next, &curr, &prev)) {
 			result = false;
 			break;
 		}
 		nexts = unmark(next);
 		currs = unmark(curr);
 		prevs = unmark(prev);
-		if (!ck_pr_cas_ptr(&currs->next, next, mark(next))) {
+		if (!ctr_cas(ck_pr_cas_ptr(&currs->next, next, mark(next)))) {
+			CTR_INC(CTR_RESTART_CAS);
 			continue;
 		}
-		if (ck_pr_cas_ptr(&prevs->next, unmark(curr), next)) {
-			retire_push(target);
+		if (ctr_cas(ck_pr_cas_ptr(&prevs->next, unmark(curr), next))) {
+			smr_retire(smr, target);
 		} else {
-			find(target, tidx, &next, &curr, &prev);
+			/* Someone changed prev, search() unlinks target for us */
+			search(head, target, smr, &next, &curr, &prev);
 		}
 		result = true;
 		break;
 	}
 
-	hp_clear(tidx);
+	smr_end(smr);
 	return result;
 }
 
-static void *pthread_runner(void *arg)
+inline static bool find(lfhead_t *head, lfhead_t *target, smr_tls_t *smr)
 {
-	uint64_t tidx = (uint64_t)arg;
-	int i;
+	bool result;
+	lfhead_t *next, *curr, *prev;
 
-	struct integer_entry *es = malloc(sizeof(*es) * OPS_PER_THREAD);
-	for (i = 0; i < OPS_PER_THREAD; ++i) {
-		es[i].x = i;
-		insert(&es[i].integers, tidx);
-		delete (&es[i].integers, tidx);
-	}
-	pthread_exit(NULL);
+	smr_begin(smr);
+	result = search(head, target, smr, &next, &curr, &prev);
+	smr_end(smr);
+	return result;
 }
 
-static void _integer_list_print(void)
+/* The keyed, sorted list lives in michael.h so the hash set can share it */
+inline static bool sorted_insert(lfhead_t *head, lfhead_t *new, smr_tls_t *smr)
 {
-	void *curr_raw = ck_pr_load_ptr(&head.next);
-	struct lflist_head *curr = unmark(curr_raw);
-	int i = 1;
+	bool result;
 
-	printf("[0]: %p\n", &head);
-	while (!LFLIST_END(&head, curr_raw)) {
-		struct integer_entry *e;
+	smr_begin(smr);
+	smr_birth(smr, new);
+	result = michael_insert(head, head, new, smr);
+	smr_end(smr);
+	return result;
+}
 
-		curr = unmark(curr_raw);
+inline static bool sorted_remove(lfhead_t *head, uint64_t key, smr_tls_t *smr)
+{
+	bool result;
 
-		if (is_marked(curr_raw)) {
-			curr_raw = curr->next;
-			continue;
-		}
-		e = lflist_entry(curr, struct integer_entry, integers);
+	smr_begin(smr);
+	result = michael_remove(head, head, key, smr);
+	smr_end(smr);
+	return result;
+}
 
-		printf("[%d]: %p -> %d\n", i, curr, e->x);
+inline static bool sorted_contains(lfhead_t *head, uint64_t key,
+				   smr_tls_t *smr)
+{
+	bool result;
 
-		curr_raw = ck_pr_load_ptr(&curr->next);
-		i += 1;
-	}
+	smr_begin(smr);
+	result = michael_contains(head, head, key, smr);
+	smr_end(smr);
+	return result;
 }
 
-static void _retire_list_print(void)
+void *michael_trfunc(void *varg)
 {
-	struct lflist_head *curr = retire_pop();
-	int i = 1;
+	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  ok = insert(head, x.node, smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = delete (head, x.node, smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  find(head, x.node, smr));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
+	}
 
-	while (curr != &retired_head) {
-		struct integer_entry *e;
-		e = lflist_entry(curr, struct integer_entry, integers);
-		printf("[%d]: %p -> %d\n", i, curr, e->x);
+	insert_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i), smr));
+	}
+	find_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_FIND, find(head, phase_node(i), smr));
+	}
+	delete_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_DELETE, delete (head, phase_node(i), smr));
+	}
 
-		curr = retire_pop();
-		i += 1;
+	all_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_FIND, find(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_DELETE, delete (head, phase_node(i), smr));
 	}
+	finish_find_phase_foreach()
+	{
+		LAT_TIMED(lat, LAT_FIND, find(head, phase_node(rops), smr));
+	}
+	finish_insdel_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT, insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_DELETE, delete (head, phase_node(i), smr));
+	}
+	smr_thread_stop(smr);
+	pthread_exit(NULL);
 }
 
-int main(void)
+void *michael_sorted_trfunc(void *varg)
 {
-	char buf[128];
-	struct pf_hw_timer timer;
+	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  ok = sorted_insert(head, x.node, smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = sorted_remove(
+						  head, to_lfkey(x.node)->key,
+						  smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  sorted_contains(
+						  head, to_lfkey(x.node)->key,
+						  smr));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
+	}
 
-	head.next = &head;
-	retired_head.retired_next = &retired_head;
-	pf_hw_timer_start(&timer);
-	for (uint64_t i = 0; i < NUM_THREADS; ++i) {
-		pthread_create(&tids[i], NULL, pthread_runner, (void *)i);
+	insert_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sorted_insert(head, phase_node(i), smr));
 	}
-	for (int i = 0; i < NUM_THREADS; ++i) {
-		pthread_join(tids[i], NULL);
+	find_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  sorted_contains(head, phase_key(i), smr));
+	}
+	delete_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_DELETE,
+			  sorted_remove(head, phase_key(i), smr));
 	}
-	pf_hw_timer_end(&timer, PF_TSC_FREQ_HZ_INTEL_12700K);
-
-	_integer_list_print();
-	// _retire_list_print();
 
-	pf_timer_pretty_time(&timer.duration, PF_HW_TIMER_US, 2, buf, 128);
-	printf("%s\n", buf);
+	all_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sorted_insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_FIND,
+			  sorted_contains(head, phase_key(i), smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  sorted_remove(head, phase_key(i), smr));
+	}
+	finish_find_phase_foreach()
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  sorted_contains(head, phase_key(rops), smr));
+	}
+	finish_insdel_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sorted_insert(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  sorted_remove(head, phase_key(i), smr));
+	}
+	smr_thread_stop(smr);
+	pthread_exit(NULL);
+}
 
-	return 0;
+/* delete() only returns once its target is unlinked, nothing is left over */
+void michael_cleanup(thr_arg_t *arg)
+{
+	(void)arg;
 }
@@ -0,0 +1,137 @@
+#ifndef MICHAEL_H
+#define MICHAEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "lf.h"
+#include "smr.h"
+
+#define LFLIST_END(head_ptr, curr_ptr) (head_ptr == unmark(curr_ptr))
+
+/* Michael's list kept in ascending key order. head is the circular list's
+ * end, start the node a walk begins at: head itself, or any node that is
+ * never deleted (the split-ordered hash set's bucket sentinels). None of
+ * these enter or leave a reclamation critical section, callers do.
+ */
+
+/* Stops at the first unmarked node whose key is >= key and returns whether
+ * that node holds key. Marked nodes on the way are unlinked.
+ */
+inline static bool michael_search(lfhead_t *head, lfhead_t *start, uint64_t key,
+				  smr_tls_t *smr, lfhead_t **pnext,
+				  lfhead_t **pcurr, lfhead_t **pprev)
+{
+	lfhead_t *next, *curr, *prev;
+	lfhead_t *currs, *prevs;
+	int cmp;
+try_again:
+	prev = start;
+	curr = smr_protect(smr, &start->next, HP_CURR);
+	while (1) {
+		prevs = unmark(prev);
+		currs = unmark(curr);
+		next = smr_protect(smr, &currs->next, HP_NEXT);
+		if (currs == head) {
+			*pprev = prev;
+			*pcurr = curr;
+			*pnext = next;
+			return false;
+		}
+		CTR_INC(CTR_TRAVERSE);
+		if (currs->next != next) {
+			CTR_INC(CTR_RESTART_VALIDATE);
+			goto try_again;
+		}
+		if (prevs->next != curr) {
+			CTR_INC(CTR_RESTART_VALIDATE);
+			goto try_again;
+		}
+		if (is_unmarked(next)) {
+			cmp = LF_KEY_CMP(to_lfkey(currs)->key, key);
+			if (cmp >= 0) {
+				*pprev = prev;
+				*pcurr = curr;
+				*pnext = next;
+				return cmp == 0;
+			}
+			prev = curr;
+			smr_inherit(smr, HP_CURR, HP_PREV);
+		} else {
+			CTR_INC(CTR_SKIP);
+			if (ctr_cas(ck_pr_cas_ptr(&prevs->next, unmark(curr),
+						  unmark(next)))) {
+				smr_retire(smr, currs);
+			} else {
+				CTR_INC(CTR_RESTART_CAS);
+				goto try_again;
+			}
+		}
+		/* After a snip prev now points at the unmarked next, which the
+		 * validation above compares against
+		 */
+		curr = unmark(next);
+		smr_inherit(smr, HP_NEXT, HP_CURR);
+	}
+}
+
+/* False if key is already in the list */
+inline static bool michael_insert(lfhead_t *head, lfhead_t *start,
+				  lfhead_t *new, smr_tls_t *smr)
+{
+	uint64_t key = to_lfkey(new)->key;
+	lfhead_t *next, *curr, *prev;
+
+	while (1) {
+		if (michael_search(head, start, key, smr, &next, &curr,
+				   &prev)) {
+			return false;
+		}
+		new->next = unmark(curr);
+		if (ctr_cas(ck_pr_cas_ptr(&unmark(prev)->next, unmark(curr),
+					  new))) {
+			return true;
+		}
+		CTR_INC(CTR_RESTART_CAS);
+	}
+}
+
+inline static bool michael_remove(lfhead_t *head, lfhead_t *start,
+				  uint64_t key, smr_tls_t *smr)
+{
+	lfhead_t *next, *curr, *prev;
+	lfhead_t *currs, *prevs;
+
+	while (1) {
+		if (!michael_search(head, start, key, smr, &next, &curr,
+				    &prev)) {
+			return false;
+		}
+		currs = unmark(curr);
+		prevs = unmark(prev);
+		if (!ctr_cas(ck_pr_cas_ptr(&currs->next, next, mark(next)))) {
+			CTR_INC(CTR_RESTART_CAS);
+			continue;
+		}
+		if (ctr_cas(ck_pr_cas_ptr(&prevs->next, currs, next))) {
+			smr_retire(smr, currs);
+		} else {
+			/* Someone changed prev, the search unlinks it for us */
+			michael_search(head, start, key, smr, &next, &curr,
+				       &prev);
+		}
+		return true;
+	}
+}
+
+inline static bool michael_contains(lfhead_t *head, lfhead_t *start,
+				    uint64_t key, smr_tls_t *smr)
+{
+	lfhead_t *next, *curr, *prev;
+
+	return michael_search(head, start, key, smr, &next, &curr, &prev);
+}
+
+#endif /* MICHAEL_H */
@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "pmu.h"
+
+#define PMU_CACHE(cache)                                   \
+	((uint64_t)(cache) |                               \
+	 ((uint64_t)PERF_COUNT_HW_CACHE_OP_READ << 8) |    \
+	 ((uint64_t)PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+} pmu_events[] = {
+	[PMU_CYCLES] = { "cycles", PERF_TYPE_HARDWARE,
+			 PERF_COUNT_HW_CPU_CYCLES },
+	[PMU_INSTRUCTIONS] = { "instructions", PERF_TYPE_HARDWARE,
+			       PERF_COUNT_HW_INSTRUCTIONS },
+	[PMU_LLC_MISSES] = { "llc_misses", PERF_TYPE_HW_CACHE,
+			     PMU_CACHE(PERF_COUNT_HW_CACHE_LL) },
+	[PMU_L1D_MISSES] = { "l1d_misses", PERF_TYPE_HW_CACHE,
+			     PMU_CACHE(PERF_COUNT_HW_CACHE_L1D) },
+	[PMU_BRANCH_MISSES] = { "branch_misses", PERF_TYPE_HARDWARE,
+				PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/* What read() returns with the read_format below */
+struct pmu_value {
+	uint64_t count;
+	uint64_t enabled;
+	uint64_t running;
+};
+
+static int perf_event_open(struct perf_event_attr *attr)
+{
+	/* This thread, any CPU, no group */
+	return (int)syscall(SYS_perf_event_open, attr, 0, -1, -1, 0);
+}
+
+int pmu_open(struct pmu *p)
+{
+	struct perf_event_attr attr;
+	int opened = 0;
+
+	for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = pmu_events[e].type;
+		attr.config = pmu_events[e].config;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+				   PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		/* User space only is what perf_event_paranoid 2 allows, and
+		 * the lists don't enter the kernel anyway.
+		 */
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		p->fd[e] = perf_event_open(&attr);
+		if (p->fd[e] >= 0) {
+			++opened;
+		}
+	}
+	return opened;
+}
+
+void pmu_close(struct pmu *p)
+{
+	for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+		if (p->fd[e] >= 0) {
+			close(p->fd[e]);
+			p->fd[e] = -1;
+		}
+	}
+}
+
+void pmu_start(struct pmu *p)
+{
+	for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+		if (p->fd[e] >= 0) {
+			ioctl(p->fd[e], PERF_EVENT_IOC_RESET, 0);
+			ioctl(p->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+}
+
+void pmu_stop(struct pmu *p, double *counts)
+{
+	struct pmu_value v;
+
+	for (int e = 0; e < PMU_EVENT_NUM; ++e) {
+		counts[e] = -1;
+		if (p->fd[e] < 0) {
+			continue;
+		}
+		ioctl(p->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(p->fd[e], &v, sizeof(v)) != (ssize_t)sizeof(v) ||
+		    v.running == 0) {
+			continue;
+		}
+		counts[e] = (double)v.count * (double)v.enabled /
+			    (double)v.running;
+	}
+}
+
+const char *pmu_event_name(enum pmu_event e)
+{
+	return pmu_events[e].name;
+}
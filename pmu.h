@@ -0,0 +1,37 @@
+#ifndef PMU_H
+#define PMU_H
+
+/* Hardware counters for the bench's timed region, through perf_event_open.
+ * The counters are opened on the thread that starts the workers and are
+ * inherited by every thread it creates while they are open, so after join
+ * they hold the sum over all workers. Whatever the kernel refuses (no PMU in
+ * a VM, perf_event_paranoid, seccomp) is just left out; the run goes on and
+ * that event reads as unavailable.
+ */
+
+enum pmu_event {
+	PMU_CYCLES,
+	PMU_INSTRUCTIONS,
+	/* Last level cache read misses */
+	PMU_LLC_MISSES,
+	PMU_L1D_MISSES,
+	PMU_BRANCH_MISSES,
+	PMU_EVENT_NUM,
+};
+
+struct pmu {
+	/* -1 for events that couldn't be opened */
+	int fd[PMU_EVENT_NUM];
+};
+
+/* Opens the events disabled, returns how many the kernel allowed */
+int pmu_open(struct pmu *p);
+void pmu_close(struct pmu *p);
+void pmu_start(struct pmu *p);
+/* Stops counting and stores each event's count, scaled up if the kernel had
+ * to multiplex it. Unavailable events are stored as -1.
+ */
+void pmu_stop(struct pmu *p, double *counts);
+const char *pmu_event_name(enum pmu_event e);
+
+#endif /* PMU_H */
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+#include <ck_pr.h>
+
+#include "lf.h"
+#include "pool.h"
+
+static size_t round_up(size_t x, size_t to)
+{
+	return (x + to - 1) / to * to;
+}
+
+/* Huge pages need the arenas on a 2 MB boundary, so a base page mapping is
+ * made one huge page larger and its start rounded up.
+ */
+static int pool_map(pool_domain_t *d, bool huge)
+{
+	size_t len = d->arena_bytes * d->rec_num;
+	void *m;
+
+	if (huge) {
+		m = mmap(NULL, len, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (m != MAP_FAILED) {
+			d->map = m;
+			d->map_bytes = len;
+			d->base = m;
+			d->pages = POOL_PAGES_HUGETLB;
+			return 0;
+		}
+		len += POOL_HUGE_BYTES;
+	}
+	m = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (m == MAP_FAILED) {
+		return -1;
+	}
+	d->map = m;
+	d->map_bytes = len;
+	d->base = huge ? (char *)round_up((uintptr_t)m, POOL_HUGE_BYTES) : m;
+	d->pages = POOL_PAGES_BASE;
+	if (huge && madvise(d->base, d->arena_bytes * d->rec_num,
+			    MADV_HUGEPAGE) == 0) {
+		d->pages = POOL_PAGES_THP;
+	}
+	return 0;
+}
+
+int pool_domain_init(pool_domain_t *d, pool_tls_t *recs, uint64_t rec_num,
+		     size_t obj_size, size_t obj_max, bool huge)
+{
+	d->recs = recs;
+	d->rec_num = rec_num;
+	d->obj_size = round_up(obj_size, CACHELINE_BYTES);
+	d->slab_bytes = huge ? POOL_HUGE_BYTES : POOL_SLAB_BYTES;
+	d->arena_bytes = round_up(d->obj_size * (obj_max ? obj_max : 1),
+				  d->slab_bytes);
+	if (pool_map(d, huge) != 0) {
+		return -1;
+	}
+
+	for (uint64_t i = 0; i < rec_num; ++i) {
+		pool_tls_t *p = &recs[i];
+
+		p->remote = NULL;
+		p->dom = d;
+		p->active = 0;
+		p->free = NULL;
+		p->bump = d->base + d->arena_bytes * i;
+		p->slab_end = p->bump;
+		p->arena_end = p->bump + d->arena_bytes;
+		p->slabs = 0;
+	}
+	return 0;
+}
+
+void pool_domain_destroy(pool_domain_t *d)
+{
+	if (d->map) {
+		munmap(d->map, d->map_bytes);
+	}
+	d->map = NULL;
+	d->base = NULL;
+}
+
+uint64_t pool_domain_slabs(pool_domain_t *d)
+{
+	uint64_t slabs = 0;
+
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		slabs += d->recs[i].slabs;
+	}
+	return slabs;
+}
+
+const char *pool_pages_name(enum pool_pages pages)
+{
+	switch (pages) {
+	case POOL_PAGES_BASE:
+		return "base";
+	case POOL_PAGES_THP:
+		return "thp";
+	case POOL_PAGES_HUGETLB:
+		return "hugetlb";
+	default:
+		return "unknown";
+	}
+}
+
+pool_tls_t *pool_register(pool_domain_t *d)
+{
+	for (uint64_t i = 0; i < d->rec_num; ++i) {
+		pool_tls_t *p = &d->recs[i];
+
+		if (ck_pr_load_uint(&p->active) == 0 &&
+		    ck_pr_cas_uint(&p->active, 0, 1)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+void pool_unregister(pool_tls_t *p)
+{
+	ck_pr_store_uint(&p->active, 0);
+}
+
+void *pool_refill(pool_tls_t *p)
+{
+	pool_domain_t *d = p->dom;
+	void *obj;
+
+	if (ck_pr_load_ptr(&p->remote)) {
+		obj = ck_pr_fas_ptr(&p->remote, NULL);
+		p->free = *(void **)obj;
+		return obj;
+	}
+	if (p->bump + d->obj_size > p->arena_end) {
+		return NULL;
+	}
+	/* Objects may straddle slabs, the arena is contiguous */
+	while (p->bump + d->obj_size > p->slab_end) {
+		p->slab_end += d->slab_bytes;
+		++p->slabs;
+	}
+	obj = p->bump;
+	p->bump += d->obj_size;
+	return obj;
+}
+
+void pool_reclaim(lfhead_t *node, void *ctx)
+{
+	pool_domain_t *d = ctx;
+
+	if (pool_owns(d, node)) {
+		pool_put(d, node);
+	}
+}
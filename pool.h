@@ -0,0 +1,138 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "lf.h"
+
+/* Fixed size object pool with one arena per record. The domain reserves
+ * every arena up front in one mapping (pages are only touched once used),
+ * so the owner of an object is its offset into the mapping and nothing is
+ * stored in the object itself. Arenas are handed out a slab at a time, the
+ * only allocator work the pool does; everything after that is a freelist.
+ *
+ * An object freed by its owner goes on the owner's private freelist. Any
+ * other thread (typically whoever reclaims it for an SMR domain) pushes it
+ * on the owner's remote stack, which the owner takes whole once its
+ * freelist runs dry. Objects are linked through their first word.
+ */
+
+#define POOL_SLAB_BYTES ((size_t)64 << 10)
+#define POOL_HUGE_BYTES ((size_t)2 << 20)
+
+enum pool_pages {
+	POOL_PAGES_BASE,
+	/* Transparent huge pages were requested with madvise() */
+	POOL_PAGES_THP,
+	/* Explicit MAP_HUGETLB pages */
+	POOL_PAGES_HUGETLB,
+};
+
+struct pool_domain;
+
+struct pool_tls {
+	/* Objects other threads gave back. Pushed with CAS, only ever taken
+	 * whole (fas) by the owner, so there is no ABA.
+	 */
+	void *remote;
+	/* Owner-only from here on */
+	struct pool_domain *dom __attribute__((aligned(CACHELINE_BYTES)));
+	unsigned int active;
+	void *free;
+	char *bump;
+	char *slab_end;
+	char *arena_end;
+	/* Slabs carved out of the arena so far */
+	uint64_t slabs;
+} __attribute__((aligned(CACHELINE_BYTES)));
+typedef struct pool_tls pool_tls_t;
+
+struct pool_domain {
+	pool_tls_t *recs;
+	uint64_t rec_num;
+	/* Rounded up to whole cache lines */
+	size_t obj_size;
+	size_t slab_bytes;
+	size_t arena_bytes;
+	/* First arena, inside map (which is what munmap needs) */
+	char *base;
+	void *map;
+	size_t map_bytes;
+	enum pool_pages pages;
+};
+typedef struct pool_domain pool_domain_t;
+
+/* Every record can hold obj_max objects of obj_size at once. huge backs the
+ * arenas with 2 MB pages: MAP_HUGETLB if enough are reserved, transparent
+ * huge pages otherwise. Returns -1 if the arenas can't be reserved.
+ */
+int pool_domain_init(pool_domain_t *d, pool_tls_t *recs, uint64_t rec_num,
+		     size_t obj_size, size_t obj_max, bool huge);
+/* Only safe when nothing allocated from d is in use anymore */
+void pool_domain_destroy(pool_domain_t *d);
+/* Slabs carved by every record, the pool's allocator calls */
+uint64_t pool_domain_slabs(pool_domain_t *d);
+const char *pool_pages_name(enum pool_pages pages);
+
+pool_tls_t *pool_register(pool_domain_t *d);
+/* Free objects stay on the record for the next thread to register it */
+void pool_unregister(pool_tls_t *p);
+/* Takes back the remote stack, else carves the next object of the arena.
+ * NULL once the arena is used up.
+ */
+void *pool_refill(pool_tls_t *p);
+/* lf_reclaim_fn for SMR domains, ctx is the pool_domain_t. Nodes that
+ * aren't from the pool are ignored.
+ */
+void pool_reclaim(lfhead_t *node, void *ctx);
+
+inline static bool pool_owns(const pool_domain_t *d, const void *obj)
+{
+	const char *c = obj;
+
+	return c >= d->base && c < d->base + d->arena_bytes * d->rec_num;
+}
+
+inline static pool_tls_t *pool_owner(pool_domain_t *d, const void *obj)
+{
+	return &d->recs[(size_t)((const char *)obj - d->base) / d->arena_bytes];
+}
+
+inline static void *pool_get(pool_tls_t *p)
+{
+	void *obj = p->free;
+
+	if (!obj) {
+		return pool_refill(p);
+	}
+	p->free = *(void **)obj;
+	return obj;
+}
+
+/* Any thread, any object of d */
+inline static void pool_put(pool_domain_t *d, void *obj)
+{
+	pool_tls_t *o = pool_owner(d, obj);
+	void *top = ck_pr_load_ptr(&o->remote);
+
+	do {
+		*(void **)obj = top;
+	} while (!ck_pr_cas_ptr_value(&o->remote, top, obj, &top));
+}
+
+/* p's own objects skip the CAS */
+inline static void pool_free(pool_tls_t *p, void *obj)
+{
+	if (pool_owner(p->dom, obj) != p) {
+		pool_put(p->dom, obj);
+		return;
+	}
+	*(void **)obj = p->free;
+	p->free = obj;
+}
+
+#endif /* POOL_H */
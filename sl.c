@@ -0,0 +1,403 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ck_pr.h>
+
+#include "bench.h"
+#include "lf.h"
+#include "smr.h"
+
+/* Lock-free skip list (Herlihy & Shavit, after Fraser). Level 0 is a sorted
+ * Harris/Michael list through lfhead.next, the upper levels of a node are in
+ * its tower. A node is removed by marking its levels top down; whoever marks
+ * level 0 owns the removal and unlinks every level with a search, which
+ * snips marked nodes like Michael's search does.
+ *
+ * An insert links its levels bottom up and may still be doing so when the
+ * node is removed, so the node is only retired once both are done (state).
+ *
+ * Hazards: walks use HP_NEXT, HP_CURR and HP_PREV on every level. An insert
+ * of a node of height h also needs the predecessor and successor of each of
+ * its upper levels protected until they are linked, in two slots per level
+ * above HP_PREV. Records only expose as many slots as the tallest tower their
+ * thread has inserted, so scans stay short while towers are.
+ */
+
+#define SL_LEVELS (20)
+#define SL_HP_PRED(l) (HP_PREV + 2 * (l) - 1)
+#define SL_HP_SUCC(l) (HP_PREV + 2 * (l))
+#define SL_HP_NUM(h) (SL_HP_SUCC((h) - 1) + 1)
+
+enum sl_state {
+	SL_LINKING,
+	SL_LINKED,
+	SL_REMOVED,
+};
+
+struct lf_tower {
+	unsigned int height;
+	unsigned int state; /* enum sl_state */
+	/* next[0] is unused, level 0 is lfhead.next */
+	struct lfhead *next[SL_LEVELS];
+} __attribute__((aligned(CACHELINE_BYTES)));
+
+/* head doubles as the end of every level. Its height is the tallest tower
+ * inserted so far, where searches start. head is the bench's plain lfhead,
+ * so its tower is kept here.
+ */
+static lfhead_t *sl_head;
+static struct lf_tower sl_head_tower;
+/* One per node of the run, handed out by sl_setup */
+static struct lf_tower *sl_towers;
+
+inline static struct lf_tower *sl_tower(lfhead_t *node)
+{
+	return node == sl_head ? &sl_head_tower : to_sl_node(node)->tower;
+}
+
+inline static lfhead_t **sl_next(lfhead_t *node, unsigned int l)
+{
+	return l ? &sl_tower(node)->next[l] : &node->next;
+}
+
+/* P(height >= h) = 2^-(h-1) */
+inline static unsigned int sl_height(unsigned int *seed)
+{
+	unsigned int r = (unsigned int)rand_r(seed);
+	unsigned int h = 1 + (unsigned int)__builtin_ctz(~r);
+
+	return h < SL_LEVELS ? h : SL_LEVELS;
+}
+
+/* Fills preds/succs with the last node < key and the first >= key on every
+ * level, unlinking marked nodes on the way. Levels below keep stay protected
+ * in their SL_HP_* slots on return, level 0 in HP_PREV and HP_CURR.
+ */
+static bool sl_search(lfhead_t *head, uint64_t key, unsigned int keep,
+		      smr_tls_t *smr, lfhead_t **preds, lfhead_t **succs)
+{
+	/* Levels above the tallest tower only hold head */
+	unsigned int top = ck_pr_load_uint(&sl_head_tower.height);
+	lfhead_t *pred, *curr, *succ;
+
+	for (unsigned int l = top; l < SL_LEVELS; ++l) {
+		preds[l] = head;
+		succs[l] = head;
+	}
+try_again:
+	pred = head;
+	for (unsigned int l = top; l-- > 0;) {
+		curr = smr_protect(smr, sl_next(pred, l), HP_CURR);
+		if (is_marked(curr)) {
+			CTR_INC(CTR_RESTART_MARKED);
+			goto try_again;
+		}
+		while (curr != head) {
+			CTR_INC(CTR_TRAVERSE);
+			succ = smr_protect(smr, sl_next(curr, l), HP_NEXT);
+			/* curr is still linked on l, so succ is too: only a
+			 * CAS on curr could unlink it.
+			 */
+			if (ck_pr_load_ptr(sl_next(pred, l)) != curr) {
+				CTR_INC(CTR_RESTART_VALIDATE);
+				goto try_again;
+			}
+			if (is_marked(succ)) {
+				CTR_INC(CTR_SKIP);
+				if (!ctr_cas(ck_pr_cas_ptr(sl_next(pred, l), curr,
+							   unmark(succ)))) {
+					CTR_INC(CTR_RESTART_CAS);
+					goto try_again;
+				}
+				curr = unmark(succ);
+				smr_inherit(smr, HP_NEXT, HP_CURR);
+				continue;
+			}
+			if (LF_KEY_CMP(to_lfkey(curr)->key, key) >= 0) {
+				break;
+			}
+			pred = curr;
+			smr_inherit(smr, HP_CURR, HP_PREV);
+			curr = succ;
+			smr_inherit(smr, HP_NEXT, HP_CURR);
+		}
+		preds[l] = pred;
+		succs[l] = curr;
+		if (l > 0 && l < keep) {
+			smr_inherit(smr, HP_PREV, SL_HP_PRED(l));
+			smr_inherit(smr, HP_CURR, SL_HP_SUCC(l));
+		}
+	}
+	return succs[0] != head &&
+	       LF_KEY_CMP(to_lfkey(succs[0])->key, key) == 0;
+}
+
+/* Whichever of the insert and the removal finishes last retires node */
+inline static void sl_done(lfhead_t *node, enum sl_state state,
+			   smr_tls_t *smr)
+{
+	unsigned int other = state == SL_LINKED ? SL_REMOVED : SL_LINKED;
+
+	if (ck_pr_fas_uint(&sl_tower(node)->state, state) == other) {
+		smr_retire(smr, node);
+	}
+}
+
+/* False if key is already in the list */
+static bool sl_insert(lfhead_t *head, lfhead_t *new, unsigned int height,
+		      smr_tls_t *smr)
+{
+	lfhead_t *preds[SL_LEVELS], *succs[SL_LEVELS];
+	struct lf_tower *tower = to_sl_node(new)->tower;
+	uint64_t key = to_lfkey(new)->key;
+	lfhead_t *old;
+	unsigned int top;
+	bool result = true;
+
+	tower->height = height;
+	tower->state = SL_LINKING;
+	smr_reserve(smr, SL_HP_NUM(height));
+	/* Links on new levels are validated like any other, so raising it
+	 * early is fine.
+	 */
+	top = ck_pr_load_uint(&sl_head_tower.height);
+	while (top < height &&
+	       !ck_pr_cas_uint_value(&sl_head_tower.height, top, height, &top))
+		;
+
+	smr_begin(smr);
+	smr_birth(smr, new);
+	while (1) {
+		if (sl_search(head, key, height, smr, preds, succs)) {
+			result = false;
+			goto out;
+		}
+		for (unsigned int l = 0; l < height; ++l) {
+			*sl_next(new, l) = succs[l];
+		}
+		if (ctr_cas(ck_pr_cas_ptr(&preds[0]->next, succs[0], new))) {
+			break;
+		}
+		CTR_INC(CTR_RESTART_CAS);
+	}
+	for (unsigned int l = 1; l < height; ++l) {
+		while (1) {
+			/* Fails once a removal marked this level */
+			old = ck_pr_load_ptr(sl_next(new, l));
+			if (is_marked(old) ||
+			    (old != succs[l] &&
+			     !ctr_cas(ck_pr_cas_ptr(sl_next(new, l), old,
+						    succs[l])))) {
+				goto linked;
+			}
+			if (ctr_cas(ck_pr_cas_ptr(sl_next(preds[l], l),
+						  succs[l], new))) {
+				break;
+			}
+			CTR_INC(CTR_RESTART_CAS);
+			if (!sl_search(head, key, height, smr, preds,
+				       succs) ||
+			    succs[0] != new) {
+				goto linked;
+			}
+		}
+	}
+linked:
+	/* A removal may have missed the levels linked after its search */
+	if (is_marked(ck_pr_load_ptr(&new->next))) {
+		sl_search(head, key, 1, smr, preds, succs);
+	}
+	sl_done(new, SL_LINKED, smr);
+out:
+	smr_clear_slots(smr, SL_HP_PRED(1), SL_HP_NUM(height));
+	smr_end(smr);
+	return result;
+}
+
+static bool sl_remove(lfhead_t *head, uint64_t key, smr_tls_t *smr)
+{
+	lfhead_t *preds[SL_LEVELS], *succs[SL_LEVELS];
+	lfhead_t *victim, *next;
+	bool result = false;
+
+	smr_begin(smr);
+	if (!sl_search(head, key, 1, smr, preds, succs)) {
+		goto out;
+	}
+	/* Protected in HP_CURR */
+	victim = succs[0];
+	for (unsigned int l = sl_tower(victim)->height; l-- > 1;) {
+		next = ck_pr_load_ptr(sl_next(victim, l));
+		while (is_unmarked(next) &&
+		       !ctr_cas(ck_pr_cas_ptr_value(sl_next(victim, l), next,
+						    mark(next), &next)))
+			;
+	}
+	next = ck_pr_load_ptr(&victim->next);
+	while (1) {
+		if (is_marked(next)) {
+			/* Another remover owns it */
+			goto out;
+		}
+		if (ctr_cas(ck_pr_cas_ptr_value(&victim->next, next,
+						mark(next), &next))) {
+			break;
+		}
+	}
+	sl_search(head, key, 1, smr, preds, succs);
+	sl_done(victim, SL_REMOVED, smr);
+	result = true;
+out:
+	smr_end(smr);
+	return result;
+}
+
+static bool sl_contains(lfhead_t *head, uint64_t key, smr_tls_t *smr)
+{
+	lfhead_t *preds[SL_LEVELS], *succs[SL_LEVELS];
+	bool result;
+
+	smr_begin(smr);
+	result = sl_search(head, key, 1, smr, preds, succs);
+	smr_end(smr);
+	return result;
+}
+
+void *sl_trfunc(void *varg)
+{
+	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  ok = sl_insert(head, x.node,
+							 sl_height(seed), smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = sl_remove(
+						  head, to_lfkey(x.node)->key,
+						  smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  sl_contains(
+						  head, to_lfkey(x.node)->key,
+						  smr));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
+	}
+
+	insert_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sl_insert(head, phase_node(i), sl_height(seed), smr));
+	}
+	find_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_FIND, sl_contains(head, phase_key(i), smr));
+	}
+	delete_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_DELETE, sl_remove(head, phase_key(i), smr));
+	}
+
+	all_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sl_insert(head, phase_node(i), sl_height(seed), smr));
+		LAT_TIMED(lat, LAT_FIND, sl_contains(head, phase_key(i), smr));
+		LAT_TIMED(lat, LAT_DELETE, sl_remove(head, phase_key(i), smr));
+	}
+	finish_find_phase_foreach()
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  sl_contains(head, phase_key(rops), smr));
+	}
+	finish_insdel_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  sl_insert(head, phase_node(i), sl_height(seed), smr));
+		LAT_TIMED(lat, LAT_DELETE, sl_remove(head, phase_key(i), smr));
+	}
+	smr_thread_stop(smr);
+	pthread_exit(NULL);
+}
+
+static void sl_tower_set(lfhead_t *nodes, size_t stride, size_t n,
+			 struct lf_tower **next)
+{
+	char *node = (char *)nodes;
+
+	for (size_t i = 0; i < n; ++i, node += stride) {
+		to_sl_node((lfhead_t *)(void *)node)->tower = (*next)++;
+	}
+}
+
+/* Towers are allocated in one piece outside the timing and go away with
+ * the run, node memory is shared with the other lists.
+ */
+int sl_setup(thr_arg_t *args, uint64_t thrn)
+{
+	lfhead_t *head = args[0].head;
+	struct wl *w = args[0].wl;
+	struct lf_tower *next;
+	size_t n = w ? w->keys : 0;
+
+	for (uint64_t t = 0; t < thrn; ++t) {
+		n += args[t].node_num;
+	}
+	sl_towers = aligned_alloc(CACHELINE_BYTES, sizeof(*sl_towers) * n);
+	if (!sl_towers) {
+		return -1;
+	}
+	next = sl_towers;
+	for (uint64_t t = 0; t < thrn; ++t) {
+		sl_tower_set(args[t].nodes, args[t].node_stride,
+			     args[t].node_num, &next);
+	}
+	if (w) {
+		sl_tower_set(w->nodes, w->stride, w->keys, &next);
+	}
+
+	sl_head = head;
+	memset(&sl_head_tower, 0, sizeof(sl_head_tower));
+	sl_head_tower.height = 1;
+	for (unsigned int l = 1; l < SL_LEVELS; ++l) {
+		sl_head_tower.next[l] = head;
+	}
+	return 0;
+}
+
+/* A removal unlinks every level before it returns, nothing reads a tower
+ * once the threads are done.
+ */
+void sl_cleanup(thr_arg_t *arg)
+{
+	(void)arg;
+	free(sl_towers);
+	sl_towers = NULL;
+}
@@ -0,0 +1,27 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "smr.h"
+
+static const char *const smr_names[] = {
+	[SMR_HP] = "hp",
+	[SMR_EBR] = "ebr",
+	[SMR_QSBR] = "qsbr",
+	[SMR_HE] = "he",
+};
+
+const char *smr_mode_name(enum smr_mode mode)
+{
+	return smr_names[mode];
+}
+
+int smr_mode_parse(const char *name, enum smr_mode *mode)
+{
+	for (size_t i = 0; i < sizeof(smr_names) / sizeof(*smr_names); ++i) {
+		if (strcmp(name, smr_names[i]) == 0) {
+			*mode = (enum smr_mode)i;
+			return 0;
+		}
+	}
+	return -1;
+}
@@ -0,0 +1,139 @@
+#ifndef SMR_H
+#define SMR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "ebr.h"
+#include "he.h"
+#include "lf.h"
+
+/* Safe memory reclamation modes a list can be run with. Lists call the
+ * smr_* wrappers and the mode decides what each one costs:
+ * HP:   protect posts a hazard per hop, retire scans hazards.
+ * HE:   protect only publishes when the global era moved since the last
+ *       publish, retire scans published eras against node lifetimes.
+ * EBR:  begin/end announce the epoch (one fence per operation).
+ * QSBR: no fence or announcement inside an operation; threads report a
+ *       quiescent state once each operation is done.
+ * Lists that can't support a mode (Zhang with HP or HE) reject it at
+ * startup.
+ */
+enum smr_mode {
+	SMR_HP,
+	SMR_EBR,
+	SMR_QSBR,
+	SMR_HE,
+};
+
+struct smr_tls {
+	enum smr_mode mode;
+	hp_tls_t *hp;
+	ebr_tls_t *ebr;
+	he_tls_t *he;
+};
+typedef struct smr_tls smr_tls_t;
+
+const char *smr_mode_name(enum smr_mode mode);
+/* Returns -1 for an unknown name */
+int smr_mode_parse(const char *name, enum smr_mode *mode);
+
+inline static void smr_thread_start(smr_tls_t *s)
+{
+	if (s->mode == SMR_QSBR) {
+		qsbr_online(s->ebr);
+	}
+}
+
+inline static void smr_thread_stop(smr_tls_t *s)
+{
+	if (s->mode == SMR_QSBR) {
+		qsbr_offline(s->ebr);
+	}
+}
+
+/* Called on a node before it is linked */
+inline static void smr_birth(smr_tls_t *s, lfhead_t *node)
+{
+	if (s->mode == SMR_HE) {
+		he_birth(s->he, node);
+	}
+}
+
+inline static void smr_begin(smr_tls_t *s)
+{
+	if (s->mode == SMR_EBR) {
+		ebr_enter(s->ebr);
+	}
+}
+
+/* The end of an operation is where a QSBR thread holds no references, so
+ * that is where it reports its quiescent state.
+ */
+inline static void smr_end(smr_tls_t *s)
+{
+	if (s->mode == SMR_HP) {
+		hp_clear(s->hp);
+	} else if (s->mode == SMR_HE) {
+		he_clear(s->he);
+	} else if (s->mode == SMR_EBR) {
+		ebr_exit(s->ebr);
+	} else {
+		qsbr_quiescent(s->ebr);
+	}
+}
+
+inline static lfhead_t *smr_protect(smr_tls_t *s, lfhead_t **src, uint64_t n)
+{
+	if (s->mode == SMR_HP) {
+		return hp_post(s->hp, src, n);
+	} else if (s->mode == SMR_HE) {
+		return he_protect(s->he, src, n);
+	}
+	return ck_pr_load_ptr(src);
+}
+
+/* Slots past the first cache line must be reserved before they are used
+ * (see hp_reserve). smr_end only clears the three the lists use.
+ */
+inline static void smr_reserve(smr_tls_t *s, uint64_t n)
+{
+	if (s->mode == SMR_HP) {
+		hp_reserve(s->hp, n);
+	} else if (s->mode == SMR_HE) {
+		he_reserve(s->he, n);
+	}
+}
+
+inline static void smr_clear_slots(smr_tls_t *s, uint64_t from, uint64_t to)
+{
+	if (s->mode == SMR_HP) {
+		hp_clear_slots(s->hp, from, to);
+	} else if (s->mode == SMR_HE) {
+		he_clear_slots(s->he, from, to);
+	}
+}
+
+inline static void smr_inherit(smr_tls_t *s, uint64_t from, uint64_t to)
+{
+	if (s->mode == SMR_HP) {
+		hp_inherit(s->hp, from, to);
+	} else if (s->mode == SMR_HE) {
+		he_inherit(s->he, from, to);
+	}
+}
+
+inline static void smr_retire(smr_tls_t *s, lfhead_t *tar)
+{
+	if (s->mode == SMR_HP) {
+		hp_retire(s->hp, tar);
+	} else if (s->mode == SMR_HE) {
+		he_retire(s->he, tar);
+	} else {
+		ebr_retire(s->ebr, tar);
+	}
+}
+
+#endif /* SMR_H */
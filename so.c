@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ck_pr.h>
+
+#include "bench.h"
+#include "lf.h"
+#include "michael.h"
+#include "smr.h"
+#include "so.h"
+
+static lfhead_t *so_sentinel_alloc(uint64_t b)
+{
+	struct lfkey *s = aligned_alloc(sizeof(*s), sizeof(*s));
+
+	if (!s) {
+		fprintf(stderr, "Failed to allocate sentinel for bucket %lu\n",
+			b);
+		abort();
+	}
+	memset(s, 0, sizeof(*s));
+	s->key = so_key_sentinel(b);
+	return &s->head;
+}
+
+/* Segments are published with a CAS, the loser frees its copy */
+static lfhead_t **so_slot_alloc(struct so_set *so, uint64_t b)
+{
+	unsigned int s = so_seg(b);
+	size_t n = s ? (size_t)1 << (s - 1) : 1;
+	lfhead_t **slot, **seg;
+
+	while (!(slot = so_slot(so, b))) {
+		seg = calloc(n, sizeof(*seg));
+		if (!seg) {
+			fprintf(stderr, "Failed to allocate %zu buckets\n", n);
+			abort();
+		}
+		if (!ck_pr_cas_ptr(&so->segs[s], NULL, seg)) {
+			free(seg);
+		}
+	}
+	return slot;
+}
+
+lfhead_t *so_bucket_init(struct so_set *so, uint64_t b, smr_tls_t *smr)
+{
+	lfhead_t **slot = so_slot_alloc(so, b);
+	lfhead_t **pslot;
+	lfhead_t *parent, *s, *next, *curr, *prev;
+	uint64_t p;
+
+	s = ck_pr_load_ptr(slot);
+	if (s) {
+		return s;
+	}
+	/* Bucket 0 is set up by so_set_init, so b has a top bit to drop */
+	p = b & ~(1ULL << (63 - __builtin_clzll(b)));
+	pslot = so_slot(so, p);
+	parent = pslot ? ck_pr_load_ptr(pslot) : NULL;
+	if (!parent) {
+		parent = so_bucket_init(so, p, smr);
+	}
+
+	s = so_sentinel_alloc(b);
+	while (1) {
+		if (michael_search(so->head, parent, to_lfkey(s)->key, smr,
+				   &next, &curr, &prev)) {
+			/* Someone else linked it first, use theirs */
+			free(to_lfkey(s));
+			s = unmark(curr);
+			break;
+		}
+		s->next = unmark(curr);
+		if (ctr_cas(ck_pr_cas_ptr(&unmark(prev)->next, unmark(curr),
+					  s))) {
+			break;
+		}
+		CTR_INC(CTR_RESTART_CAS);
+	}
+	/* Anyone who beat us here published the same node */
+	ck_pr_cas_ptr(slot, NULL, s);
+	return s;
+}
+
+int so_set_init(struct so_set *so, lfhead_t *head)
+{
+	struct lfkey *s;
+
+	memset(so->segs, 0, sizeof(so->segs));
+	so->head = head;
+	so->size = SO_SIZE_MIN;
+	so->count = 0;
+	so->segs[0] = calloc(1, sizeof(*so->segs[0]));
+	s = aligned_alloc(sizeof(*s), sizeof(*s));
+	if (!so->segs[0] || !s) {
+		free(so->segs[0]);
+		free(s);
+		so->segs[0] = NULL;
+		return -1;
+	}
+	memset(s, 0, sizeof(*s));
+	s->key = so_key_sentinel(0);
+	s->head.next = head;
+	head->next = &s->head;
+	so->segs[0][0] = &s->head;
+	return 0;
+}
+
+void so_set_destroy(struct so_set *so)
+{
+	lfhead_t *prev = so->head;
+	lfhead_t *curr = prev->next;
+
+	while (curr != so->head) {
+		if (to_lfkey(curr)->key & 1) {
+			prev = curr;
+			curr = curr->next;
+			continue;
+		}
+		prev->next = curr->next;
+		free(to_lfkey(curr));
+		curr = prev->next;
+	}
+	for (unsigned int s = 0; s < SO_SEG_NUM; ++s) {
+		free(so->segs[s]);
+		so->segs[s] = NULL;
+	}
+}
+
+void *so_trfunc(void *varg)
+{
+	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+	struct so_set *so = arg->so;
+	/* Phase keys are unique across threads, node keys are rewritten */
+	uint64_t base = arg->tidx * node_num;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  ok = so_insert(so, x.node, op->key,
+							 smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = so_remove(so, op->key, smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  so_contains(so, op->key, smr));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
+	}
+
+	insert_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  so_insert(so, phase_node(i), base + i, smr));
+	}
+	find_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_FIND, so_contains(so, base + i, smr));
+	}
+	delete_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_DELETE, so_remove(so, base + i, smr));
+	}
+
+	all_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  so_insert(so, phase_node(i), base + i, smr));
+		LAT_TIMED(lat, LAT_FIND, so_contains(so, base + i, smr));
+		LAT_TIMED(lat, LAT_DELETE, so_remove(so, base + i, smr));
+	}
+	finish_find_phase_foreach()
+	{
+		LAT_TIMED(lat, LAT_FIND,
+			  so_contains(so, base + (uint64_t)rops, smr));
+	}
+	finish_insdel_phase_foreach(i)
+	{
+		LAT_TIMED(lat, LAT_INSERT,
+			  so_insert(so, phase_node(i), base + i, smr));
+		LAT_TIMED(lat, LAT_DELETE, so_remove(so, base + i, smr));
+	}
+	smr_thread_stop(smr);
+	pthread_exit(NULL);
+}
+
+int so_setup(thr_arg_t *args, uint64_t thrn)
+{
+	(void)thrn;
+	return so_set_init(args[0].so, args[0].head);
+}
+
+/* Drops the sentinels so only elements are left for verify */
+void so_cleanup(thr_arg_t *arg)
+{
+	so_set_destroy(arg->so);
+}
@@ -0,0 +1,153 @@
+#ifndef SO_H
+#define SO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "lf.h"
+#include "michael.h"
+#include "smr.h"
+
+/* Split-ordered hash set (Shalev & Shavit). Every element lives in one
+ * Michael list (michael.h) sorted by the bit reversed hash, so a bucket is
+ * a contiguous run of it and doubling the table never moves a node. Each
+ * bucket points at a sentinel node in the list where its run starts;
+ * sentinels are linked the first time a bucket is used, after the parent
+ * bucket's (the index without its top bit), and never deleted.
+ *
+ * The bucket array is a directory of segments. Segment 0 holds bucket 0 and
+ * segment s > 0 buckets [2^(s-1), 2^s), so growing only allocates the new
+ * half and the published size is the only thing a resize changes.
+ *
+ * Nodes are struct lfkey. Keys must be below 2^63, the node's key is
+ * overwritten with the split-order key on insert, so a caller sharing nodes
+ * with other lists resets their keys before reusing them (bench.c does it
+ * before every run).
+ */
+
+#define SO_SEG_NUM (32)
+#define SO_SIZE_MIN (2)
+/* Average elements per bucket before the table doubles */
+#define SO_LOAD (2)
+#define SO_KEY_MAX (UINT64_MAX >> 1)
+
+struct so_set {
+	lfhead_t *head;
+	lfhead_t **segs[SO_SEG_NUM];
+	/* Buckets in use, a power of two */
+	uint64_t size __attribute__((aligned(CACHELINE_BYTES)));
+	uint64_t count __attribute__((aligned(CACHELINE_BYTES)));
+} __attribute__((aligned(CACHELINE_BYTES)));
+
+/* head must be an empty list. Returns -1 if bucket 0 couldn't be set up. */
+int so_set_init(struct so_set *so, lfhead_t *head);
+/* Only safe when no thread uses the set. Unlinks and frees the sentinels,
+ * leaving just the elements on head, and frees the directory.
+ */
+void so_set_destroy(struct so_set *so);
+/* Links b's sentinel (and its parents') and returns it. Aborts if a node
+ * can't be allocated.
+ */
+lfhead_t *so_bucket_init(struct so_set *so, uint64_t b, smr_tls_t *smr);
+
+inline static uint64_t so_reverse(uint64_t x)
+{
+	x = ((x >> 1) & 0x5555555555555555ULL) |
+	    ((x & 0x5555555555555555ULL) << 1);
+	x = ((x >> 2) & 0x3333333333333333ULL) |
+	    ((x & 0x3333333333333333ULL) << 2);
+	x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) |
+	    ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return __builtin_bswap64(x);
+}
+
+/* Elements are odd and sort after their bucket's sentinel, which is even */
+inline static uint64_t so_key_regular(uint64_t key)
+{
+	return so_reverse(key) | 1;
+}
+
+inline static uint64_t so_key_sentinel(uint64_t b)
+{
+	return so_reverse(b);
+}
+
+inline static unsigned int so_seg(uint64_t b)
+{
+	return b ? 64 - (unsigned int)__builtin_clzll(b) : 0;
+}
+
+inline static lfhead_t **so_slot(struct so_set *so, uint64_t b)
+{
+	unsigned int s = so_seg(b);
+	lfhead_t **seg = ck_pr_load_ptr(&so->segs[s]);
+
+	if (!seg) {
+		return NULL;
+	}
+	return &seg[s ? b - (1ULL << (s - 1)) : 0];
+}
+
+inline static lfhead_t *so_bucket(struct so_set *so, uint64_t key,
+				  smr_tls_t *smr)
+{
+	uint64_t b = key & (ck_pr_load_64(&so->size) - 1);
+	lfhead_t **slot = so_slot(so, b);
+	lfhead_t *s = slot ? ck_pr_load_ptr(slot) : NULL;
+
+	return s ? s : so_bucket_init(so, b, smr);
+}
+
+/* False if key is already in the set */
+inline static bool so_insert(struct so_set *so, lfhead_t *new, uint64_t key,
+			     smr_tls_t *smr)
+{
+	uint64_t size, count;
+	bool result;
+
+	smr_begin(smr);
+	smr_birth(smr, new);
+	to_lfkey(new)->key = so_key_regular(key);
+	result = michael_insert(so->head, so_bucket(so, key, smr), new, smr);
+	smr_end(smr);
+	if (!result) {
+		return false;
+	}
+	count = ck_pr_faa_64(&so->count, 1) + 1;
+	size = ck_pr_load_64(&so->size);
+	if (count / size > SO_LOAD && size < (1ULL << (SO_SEG_NUM - 1))) {
+		/* Losing just means someone else doubled it */
+		ck_pr_cas_64(&so->size, size, size * 2);
+	}
+	return true;
+}
+
+inline static bool so_remove(struct so_set *so, uint64_t key, smr_tls_t *smr)
+{
+	bool result;
+
+	smr_begin(smr);
+	result = michael_remove(so->head, so_bucket(so, key, smr),
+				so_key_regular(key), smr);
+	smr_end(smr);
+	if (result) {
+		ck_pr_dec_64(&so->count);
+	}
+	return result;
+}
+
+inline static bool so_contains(struct so_set *so, uint64_t key,
+			       smr_tls_t *smr)
+{
+	bool result;
+
+	smr_begin(smr);
+	result = michael_contains(so->head, so_bucket(so, key, smr),
+				  so_key_regular(key), smr);
+	smr_end(smr);
+	return result;
+}
+
+#endif /* SO_H */
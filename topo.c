@@ -0,0 +1,397 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "topo.h"
+
+#define TOPO_SYSFS "/sys/devices/system/cpu/cpu%d"
+#define TOPO_LONG_BITS (sizeof(unsigned long) * 8)
+
+static const char *const topo_pin_names[] = {
+	[TOPO_PIN_NONE] = "none",
+	[TOPO_PIN_COMPACT] = "compact",
+	[TOPO_PIN_SCATTER] = "scatter",
+	[TOPO_PIN_NUMA] = "numa",
+	[TOPO_PIN_LIST] = "list",
+};
+
+static const char *const topo_mem_names[] = {
+	[TOPO_MEM_DEFAULT] = "default",
+	[TOPO_MEM_LOCAL] = "local",
+	[TOPO_MEM_INTERLEAVE] = "interleave",
+};
+
+static int sysfs_int(int cpu, const char *file, int dflt)
+{
+	char path[128];
+	FILE *f;
+	int v;
+
+	snprintf(path, sizeof(path), TOPO_SYSFS "/topology/%s", cpu, file);
+	f = fopen(path, "r");
+	if (!f) {
+		return dflt;
+	}
+	if (fscanf(f, "%d", &v) != 1) {
+		v = dflt;
+	}
+	fclose(f);
+	return v;
+}
+
+/* The cpuN directory links the node the CPU belongs to as nodeM */
+static int sysfs_node(int cpu)
+{
+	char path[128];
+	struct dirent *e;
+	DIR *d;
+	int node = 0;
+
+	snprintf(path, sizeof(path), TOPO_SYSFS, cpu);
+	d = opendir(path);
+	if (!d) {
+		return 0;
+	}
+	while ((e = readdir(d))) {
+		if (sscanf(e->d_name, "node%d", &node) == 1) {
+			break;
+		}
+	}
+	closedir(d);
+	return node;
+}
+
+static int int_cmp(const void *a, const void *b)
+{
+	int ia = *(const int *)a;
+	int ib = *(const int *)b;
+
+	return (ia > ib) - (ia < ib);
+}
+
+/* Sorted, without duplicates */
+static size_t uniq(int *v, size_t n)
+{
+	size_t u = 0;
+
+	qsort(v, n, sizeof(*v), int_cmp);
+	for (size_t i = 0; i < n; ++i) {
+		if (u == 0 || v[u - 1] != v[i]) {
+			v[u++] = v[i];
+		}
+	}
+	return u;
+}
+
+int topo_init(struct topo *t)
+{
+	cpu_set_t set;
+	int *packages;
+
+	memset(t, 0, sizeof(*t));
+	if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+		return -1;
+	}
+	t->cpus = calloc((size_t)CPU_COUNT(&set), sizeof(*t->cpus));
+	t->nodes = calloc((size_t)CPU_COUNT(&set), sizeof(*t->nodes));
+	packages = calloc((size_t)CPU_COUNT(&set), sizeof(*packages));
+	if (!t->cpus || !t->nodes || !packages) {
+		free(packages);
+		topo_destroy(t);
+		return -1;
+	}
+	for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		struct topo_cpu *c;
+
+		if (!CPU_ISSET((size_t)cpu, &set)) {
+			continue;
+		}
+		c = &t->cpus[t->cpu_num];
+		c->cpu = cpu;
+		c->package = sysfs_int(cpu, "physical_package_id", 0);
+		c->core = sysfs_int(cpu, "core_id", cpu);
+		c->node = sysfs_node(cpu);
+		t->nodes[t->cpu_num] = c->node;
+		packages[t->cpu_num] = c->package;
+		++t->cpu_num;
+	}
+	t->node_num = uniq(t->nodes, t->cpu_num);
+	t->package_num = uniq(packages, t->cpu_num);
+	free(packages);
+	return 0;
+}
+
+void topo_destroy(struct topo *t)
+{
+	free(t->cpus);
+	free(t->nodes);
+	memset(t, 0, sizeof(*t));
+}
+
+static const struct topo_cpu *topo_cpu_find(const struct topo *t, int cpu)
+{
+	for (size_t i = 0; i < t->cpu_num; ++i) {
+		if (t->cpus[i].cpu == cpu) {
+			return &t->cpus[i];
+		}
+	}
+	return NULL;
+}
+
+/* Sort keys for the two orders. sibling is the CPU's index among the SMT
+ * threads of its core, rank its core's index within its package.
+ */
+struct topo_key {
+	const struct topo_cpu *c;
+	int sibling;
+	int rank;
+};
+
+static int compact_cmp(const void *a, const void *b)
+{
+	const struct topo_cpu *x = ((const struct topo_key *)a)->c;
+	const struct topo_cpu *y = ((const struct topo_key *)b)->c;
+
+	if (x->package != y->package) {
+		return int_cmp(&x->package, &y->package);
+	}
+	if (x->core != y->core) {
+		return int_cmp(&x->core, &y->core);
+	}
+	return int_cmp(&x->cpu, &y->cpu);
+}
+
+static int scatter_cmp(const void *a, const void *b)
+{
+	const struct topo_key *x = a;
+	const struct topo_key *y = b;
+
+	if (x->sibling != y->sibling) {
+		return int_cmp(&x->sibling, &y->sibling);
+	}
+	if (x->rank != y->rank) {
+		return int_cmp(&x->rank, &y->rank);
+	}
+	return int_cmp(&x->c->package, &y->c->package);
+}
+
+static void topo_order(const struct topo *t, enum topo_pin pin,
+		       struct topo_key *keys)
+{
+	for (size_t i = 0; i < t->cpu_num; ++i) {
+		keys[i].c = &t->cpus[i];
+	}
+	qsort(keys, t->cpu_num, sizeof(*keys), compact_cmp);
+	if (pin != TOPO_PIN_SCATTER) {
+		return;
+	}
+	/* Compact order has each package's cores, and each core's
+	 * siblings, next to each other
+	 */
+	for (size_t i = 0; i < t->cpu_num; ++i) {
+		const struct topo_key *p = i ? &keys[i - 1] : NULL;
+
+		if (!p || p->c->package != keys[i].c->package) {
+			keys[i].rank = 0;
+			keys[i].sibling = 0;
+		} else if (p->c->core != keys[i].c->core) {
+			keys[i].rank = p->rank + 1;
+			keys[i].sibling = 0;
+		} else {
+			keys[i].rank = p->rank;
+			keys[i].sibling = p->sibling + 1;
+		}
+	}
+	qsort(keys, t->cpu_num, sizeof(*keys), scatter_cmp);
+}
+
+int topo_plan(const struct topo *t, const struct topo_pin_cfg *c,
+	      struct topo_slot *slots, size_t n)
+{
+	struct topo_key *keys;
+	const struct topo_cpu *cpu;
+
+	switch (c->pin) {
+	case TOPO_PIN_NONE:
+		for (size_t i = 0; i < n; ++i) {
+			slots[i].cpu = -1;
+			slots[i].node = -1;
+		}
+		return 0;
+	case TOPO_PIN_NUMA:
+		for (size_t i = 0; i < n; ++i) {
+			slots[i].cpu = -1;
+			slots[i].node = t->nodes[i % t->node_num];
+		}
+		return 0;
+	case TOPO_PIN_LIST:
+		for (size_t i = 0; i < n; ++i) {
+			cpu = topo_cpu_find(t, c->cpus[i % c->cpu_num]);
+			if (!cpu) {
+				return -1;
+			}
+			slots[i].cpu = cpu->cpu;
+			slots[i].node = cpu->node;
+		}
+		return 0;
+	case TOPO_PIN_COMPACT:
+	case TOPO_PIN_SCATTER:
+	default:
+		break;
+	}
+	keys = calloc(t->cpu_num, sizeof(*keys));
+	if (!keys) {
+		return -1;
+	}
+	topo_order(t, c->pin, keys);
+	for (size_t i = 0; i < n; ++i) {
+		slots[i].cpu = keys[i % t->cpu_num].c->cpu;
+		slots[i].node = keys[i % t->cpu_num].c->node;
+	}
+	free(keys);
+	return 0;
+}
+
+int topo_attr(const struct topo *t, const struct topo_slot *s,
+	      pthread_attr_t *attr)
+{
+	cpu_set_t set;
+
+	if (s->cpu < 0 && s->node < 0) {
+		return 0;
+	}
+	CPU_ZERO(&set);
+	if (s->cpu >= 0) {
+		CPU_SET((size_t)s->cpu, &set);
+	} else {
+		for (size_t i = 0; i < t->cpu_num; ++i) {
+			if (t->cpus[i].node == s->node) {
+				CPU_SET((size_t)t->cpus[i].cpu, &set);
+			}
+		}
+	}
+	return pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
+
+/* mbind(2) without libnuma */
+int topo_mem_place(const struct topo *t, void *addr, size_t len, int node)
+{
+	uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t start = ((uintptr_t)addr + page - 1) & ~(page - 1);
+	uintptr_t end = ((uintptr_t)addr + len) & ~(page - 1);
+	int node_max = node;
+	unsigned long *mask;
+	size_t words;
+	long err;
+
+	if (end <= start) {
+		return 0;
+	}
+	for (size_t i = 0; i < t->node_num; ++i) {
+		node_max = t->nodes[i] > node_max ? t->nodes[i] : node_max;
+	}
+	words = (size_t)node_max / TOPO_LONG_BITS + 1;
+	mask = calloc(words, sizeof(*mask));
+	if (!mask) {
+		return -1;
+	}
+	for (size_t i = 0; i < t->node_num; ++i) {
+		size_t n = (size_t)(node >= 0 ? node : t->nodes[i]);
+
+		mask[n / TOPO_LONG_BITS] |= 1UL << (n % TOPO_LONG_BITS);
+	}
+	/* The kernel reads maxnode - 1 bits */
+	err = syscall(SYS_mbind, start, end - start,
+		      node >= 0 ? MPOL_PREFERRED : MPOL_INTERLEAVE, mask,
+		      words * TOPO_LONG_BITS + 1, MPOL_MF_MOVE);
+	free(mask);
+	return err == 0 ? 0 : -1;
+}
+
+static int cpu_list_parse(const char *str, struct topo_pin_cfg *c)
+{
+	const char *p = str;
+	char *end;
+	long lo, hi;
+	int *cpus;
+
+	c->cpu_num = 0;
+	while (*p) {
+		lo = strtol(p, &end, 10);
+		hi = lo;
+		if (end == p || lo < 0 || lo >= CPU_SETSIZE) {
+			return -1;
+		}
+		if (*end == '-') {
+			p = end + 1;
+			hi = strtol(p, &end, 10);
+			if (end == p || hi < lo || hi >= CPU_SETSIZE) {
+				return -1;
+			}
+		}
+		cpus = realloc(c->cpus,
+			       (c->cpu_num + (size_t)(hi - lo) + 1) * sizeof(*cpus));
+		if (!cpus) {
+			return -1;
+		}
+		c->cpus = cpus;
+		for (long cpu = lo; cpu <= hi; ++cpu) {
+			c->cpus[c->cpu_num++] = (int)cpu;
+		}
+		if (*end == ',') {
+			++end;
+		} else if (*end != '\0') {
+			return -1;
+		}
+		p = end;
+	}
+	return c->cpu_num ? 0 : -1;
+}
+
+int topo_pin_parse(const char *str, struct topo_pin_cfg *c)
+{
+	if (strncmp(str, "list:", 5) == 0) {
+		c->pin = TOPO_PIN_LIST;
+		return cpu_list_parse(str + 5, c);
+	}
+	for (size_t i = 0; i < sizeof(topo_pin_names) / sizeof(*topo_pin_names);
+	     ++i) {
+		if (i != (size_t)TOPO_PIN_LIST &&
+		    strcmp(str, topo_pin_names[i]) == 0) {
+			c->pin = (enum topo_pin)i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char *topo_pin_name(enum topo_pin pin)
+{
+	return topo_pin_names[pin];
+}
+
+int topo_mem_parse(const char *str, enum topo_mem *mem)
+{
+	for (size_t i = 0; i < sizeof(topo_mem_names) / sizeof(*topo_mem_names);
+	     ++i) {
+		if (strcmp(str, topo_mem_names[i]) == 0) {
+			*mem = (enum topo_mem)i;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+const char *topo_mem_name(enum topo_mem mem)
+{
+	return topo_mem_names[mem];
+}
@@ -0,0 +1,92 @@
+#ifndef TOPO_H
+#define TOPO_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* CPU topology of the CPUs the bench may run on (its affinity mask), read
+ * from sysfs, and where each worker thread and its nodes go. Without sysfs
+ * every CPU is its own core on package and NUMA node 0.
+ */
+
+enum topo_pin {
+	/* Left to the scheduler */
+	TOPO_PIN_NONE,
+	/* Fill a package core by core, SMT siblings next to each other */
+	TOPO_PIN_COMPACT,
+	/* Alternate packages, a core's siblings only once every core has a
+	 * thread
+	 */
+	TOPO_PIN_SCATTER,
+	/* Round robin over NUMA nodes, any CPU of the node */
+	TOPO_PIN_NUMA,
+	/* The CPUs given, in order */
+	TOPO_PIN_LIST,
+};
+
+enum topo_mem {
+	/* First touch */
+	TOPO_MEM_DEFAULT,
+	/* A thread's nodes on the NUMA node it is pinned to */
+	TOPO_MEM_LOCAL,
+	/* Pages spread over every NUMA node */
+	TOPO_MEM_INTERLEAVE,
+};
+
+struct topo_pin_cfg {
+	enum topo_pin pin;
+	/* TOPO_PIN_LIST only */
+	int *cpus;
+	size_t cpu_num;
+};
+
+struct topo_cpu {
+	int cpu;
+	int package;
+	int core;
+	int node;
+};
+
+struct topo {
+	/* Ascending CPU number */
+	struct topo_cpu *cpus;
+	size_t cpu_num;
+	/* Distinct ids, ascending */
+	int *nodes;
+	size_t node_num;
+	size_t package_num;
+};
+
+/* Where one thread runs: a CPU, any CPU of a node (cpu -1) or anywhere (both
+ * -1). node is also where its memory goes for TOPO_MEM_LOCAL.
+ */
+struct topo_slot {
+	int cpu;
+	int node;
+};
+
+int topo_init(struct topo *t);
+void topo_destroy(struct topo *t);
+/* Fills slots for threads [0, n), wrapping around when there are more
+ * threads than CPUs (or nodes). -1 if a listed CPU isn't one we may use.
+ */
+int topo_plan(const struct topo *t, const struct topo_pin_cfg *c,
+	      struct topo_slot *slots, size_t n);
+/* Sets the affinity of s on attr, nothing for an unpinned slot */
+int topo_attr(const struct topo *t, const struct topo_slot *s,
+	      pthread_attr_t *attr);
+/* Moves the whole pages of [addr, addr + len) to node, or spreads them over
+ * every node for node -1. Returns -1 if the kernel refuses.
+ */
+int topo_mem_place(const struct topo *t, void *addr, size_t len, int node);
+
+/* "none", "compact", "scatter", "numa" or "list:CPUS" with CPUS like
+ * 0,2,4-7
+ */
+int topo_pin_parse(const char *str, struct topo_pin_cfg *c);
+const char *topo_pin_name(enum topo_pin pin);
+/* "default", "local" or "interleave" */
+int topo_mem_parse(const char *str, enum topo_mem *mem);
+const char *topo_mem_name(enum topo_mem mem);
+
+#endif /* TOPO_H */
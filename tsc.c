@@ -0,0 +1,120 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
+#include <pf_hw_timer.h>
+
+#include "tsc.h"
+
+#define TSC_CAL_ROUNDS (5)
+#define TSC_CAL_NS (5000000)
+/* Anything below this is a broken measurement, not a real TSC */
+#define TSC_MIN_HZ (100000000)
+
+static uint64_t tsc_hz;
+
+static uint64_t clock_ns(clockid_t id)
+{
+	struct timespec ts;
+
+	clock_gettime(id, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+static bool tsc_invariant(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) ||
+	    eax < 0x80000007) {
+		return false;
+	}
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return (edx & (1u << 8)) != 0;
+}
+
+static uint64_t tsc_measure(void)
+{
+	uint64_t ns0, ns1, tsc0, tsc1;
+
+	ns0 = clock_ns(CLOCK_MONOTONIC_RAW);
+	tsc0 = __rdtsc();
+	do {
+		ns1 = clock_ns(CLOCK_MONOTONIC_RAW);
+		tsc1 = __rdtsc();
+	} while (ns1 - ns0 < TSC_CAL_NS);
+
+	return (uint64_t)((double)(tsc1 - tsc0) * 1e9 / (double)(ns1 - ns0));
+}
+
+static int hz_cmp(const void *a, const void *b)
+{
+	uint64_t ua = *(const uint64_t *)a;
+	uint64_t ub = *(const uint64_t *)b;
+
+	return (ua > ub) - (ua < ub);
+}
+
+void tsc_init(void)
+{
+	uint64_t hz[TSC_CAL_ROUNDS];
+
+	if (tsc_hz || !tsc_invariant()) {
+		return;
+	}
+	for (int i = 0; i < TSC_CAL_ROUNDS; ++i) {
+		hz[i] = tsc_measure();
+	}
+	/* The median ignores a round that got preempted */
+	qsort(hz, TSC_CAL_ROUNDS, sizeof(*hz), hz_cmp);
+	if (hz[TSC_CAL_ROUNDS / 2] >= TSC_MIN_HZ) {
+		tsc_hz = hz[TSC_CAL_ROUNDS / 2];
+	}
+}
+#else
+void tsc_init(void)
+{
+}
+#endif
+
+uint64_t tsc_freq_hz(void)
+{
+	return tsc_hz;
+}
+
+const char *tsc_clock_name(void)
+{
+	return tsc_hz ? "tsc" : "monotonic";
+}
+
+void tsc_timer_start(struct tsc_timer *t)
+{
+	if (tsc_hz) {
+		pf_hw_timer_start(&t->hw);
+	} else {
+		t->start_ns = clock_ns(CLOCK_MONOTONIC);
+	}
+}
+
+void tsc_timer_end(struct tsc_timer *t)
+{
+	uint64_t ns;
+
+	if (tsc_hz) {
+		pf_hw_timer_end(&t->hw, tsc_hz);
+		t->duration = t->hw.duration;
+		return;
+	}
+	ns = clock_ns(CLOCK_MONOTONIC) - t->start_ns;
+	t->duration.tv_sec = (time_t)(ns / 1000000000);
+	t->duration.tv_nsec = (long)(ns % 1000000000);
+}
@@ -0,0 +1,28 @@
+#ifndef TSC_H
+#define TSC_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include <pf_hw_timer.h>
+
+/* pf_hw_timer wants the TSC frequency, which differs per machine. tsc_init
+ * measures it against CLOCK_MONOTONIC_RAW once. If the CPU doesn't report an
+ * invariant TSC (or calibration looks wrong) the timers below read
+ * CLOCK_MONOTONIC instead, so durations stay correct either way.
+ */
+void tsc_init(void);
+/* 0 when timers fall back to CLOCK_MONOTONIC */
+uint64_t tsc_freq_hz(void);
+const char *tsc_clock_name(void);
+
+struct tsc_timer {
+	struct pf_hw_timer hw;
+	uint64_t start_ns;
+	struct timespec duration;
+};
+
+void tsc_timer_start(struct tsc_timer *t);
+void tsc_timer_end(struct tsc_timer *t);
+
+#endif /* TSC_H */
@@ -0,0 +1,219 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <ck_pr.h>
+
+#include "lat.h"
+#include "lf.h"
+#include "wl.h"
+
+#define WL_ZIPF_THETA (0.99)
+#define WL_HOT_KEYS (0.2)
+#define WL_HOT_OPS (0.8)
+
+/* xorshift64*, seeded through splitmix64 so nearby seeds diverge */
+static uint64_t wl_rand(uint64_t *s)
+{
+	uint64_t x = *s;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*s = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t wl_seed(uint64_t seed, uint64_t stream)
+{
+	uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ULL;
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z ^= z >> 31;
+	return z ? z : 1;
+}
+
+/* [0, 1) */
+static double wl_rand_double(uint64_t *s)
+{
+	return (double)(wl_rand(s) >> 11) / (double)(1ULL << 53);
+}
+
+static uint64_t wl_rand_range(uint64_t *s, uint64_t n)
+{
+	return (uint64_t)(wl_rand_double(s) * (double)n);
+}
+
+int wl_dist_parse(const char *str, struct wl_cfg *c)
+{
+	char *end;
+
+	if (strcmp(str, "uniform") == 0) {
+		c->dist = WL_UNIFORM;
+		return 0;
+	}
+	if (strncmp(str, "zipf", 4) == 0) {
+		c->dist = WL_ZIPF;
+		c->theta = WL_ZIPF_THETA;
+		if (str[4] == '\0') {
+			return 0;
+		}
+		if (str[4] != ':') {
+			return -1;
+		}
+		c->theta = strtod(str + 5, &end);
+		/* theta == 1 divides by zero in the generator */
+		return *end == '\0' && c->theta > 0 && c->theta < 1 ? 0 : -1;
+	}
+	if (strncmp(str, "hot", 3) == 0) {
+		c->dist = WL_HOTSPOT;
+		c->hot_keys = WL_HOT_KEYS;
+		c->hot_ops = WL_HOT_OPS;
+		if (str[3] == '\0') {
+			return 0;
+		}
+		if (str[3] != ':') {
+			return -1;
+		}
+		c->hot_keys = strtod(str + 4, &end) / 100;
+		if (*end != ':') {
+			return -1;
+		}
+		c->hot_ops = strtod(end + 1, &end) / 100;
+		return *end == '\0' && c->hot_keys > 0 && c->hot_keys < 1 &&
+				       c->hot_ops >= 0 && c->hot_ops <= 1 ?
+			       0 :
+			       -1;
+	}
+	return -1;
+}
+
+void wl_dist_name(const struct wl_cfg *c, char *buf, size_t len)
+{
+	switch (c->dist) {
+	case WL_UNIFORM:
+		snprintf(buf, len, "uniform");
+		break;
+	case WL_ZIPF:
+		snprintf(buf, len, "zipf:%.2f", c->theta);
+		break;
+	case WL_HOTSPOT:
+		snprintf(buf, len, "hot:%.0f:%.0f", c->hot_keys * 100,
+			 c->hot_ops * 100);
+		break;
+	default:
+		snprintf(buf, len, "?");
+		break;
+	}
+}
+
+static double wl_zeta(uint64_t n, double theta)
+{
+	double sum = 0;
+
+	for (uint64_t i = 1; i <= n; ++i) {
+		sum += 1 / pow((double)i, theta);
+	}
+	return sum;
+}
+
+void wl_cfg_prepare(struct wl_cfg *c)
+{
+	if (c->dist != WL_ZIPF) {
+		return;
+	}
+	/* Gray et al., "Quickly generating billion-record synthetic
+	 * databases", as used by YCSB.
+	 */
+	c->zeta_n = wl_zeta(c->keys, c->theta);
+	c->zeta_2 = wl_zeta(2, c->theta);
+	c->alpha = 1 / (1 - c->theta);
+	c->eta = (1 - pow(2.0 / (double)c->keys, 1 - c->theta)) /
+		 (1 - c->zeta_2 / c->zeta_n);
+}
+
+static uint64_t wl_key(const struct wl_cfg *c, uint64_t *s)
+{
+	uint64_t hot;
+	double u, uz;
+
+	switch (c->dist) {
+	case WL_ZIPF:
+		u = wl_rand_double(s);
+		uz = u * c->zeta_n;
+		if (uz < 1) {
+			return 0;
+		}
+		if (uz < 1 + pow(0.5, c->theta)) {
+			return 1;
+		}
+		return (uint64_t)((double)c->keys *
+				  pow(c->eta * u - c->eta + 1, c->alpha)) %
+		       c->keys;
+	case WL_HOTSPOT:
+		hot = (uint64_t)((double)c->keys * c->hot_keys);
+		hot = hot ? hot : 1;
+		if (wl_rand_double(s) < c->hot_ops || hot == c->keys) {
+			return wl_rand_range(s, hot);
+		}
+		return hot + wl_rand_range(s, c->keys - hot);
+	case WL_UNIFORM:
+	default:
+		return wl_rand_range(s, c->keys);
+	}
+}
+
+void wl_gen(const struct wl_cfg *c, uint64_t stream, uint64_t read_per,
+	    struct wl_op *ops, size_t n)
+{
+	uint64_t s = wl_seed(c->seed, stream);
+	double reads = (double)read_per / 100;
+	double inserts = reads + (1 - reads) / 2;
+
+	for (size_t i = 0; i < n; ++i) {
+		double u = wl_rand_double(&s);
+
+		ops[i].key = (uint32_t)wl_key(c, &s);
+		if (u < reads) {
+			ops[i].op = LAT_FIND;
+		} else if (u < inserts) {
+			ops[i].op = LAT_INSERT;
+		} else {
+			ops[i].op = LAT_DELETE;
+		}
+	}
+}
+
+size_t wl_gen_prefill(const struct wl_cfg *c, uint64_t tidx, uint64_t thrn,
+		      struct wl_op *ops)
+{
+	size_t n = 0;
+
+	for (uint64_t k = tidx; k < c->keys; k += thrn) {
+		if (k % 2 == 0) {
+			ops[n].key = (uint32_t)k;
+			ops[n].op = LAT_INSERT;
+			++n;
+		}
+	}
+	return n;
+}
+
+void wl_reclaim(lfhead_t *node, void *ctx)
+{
+	struct wl *w = ctx;
+	uintptr_t first = (uintptr_t)w->nodes;
+	uintptr_t last = first + w->stride * w->keys;
+	uint64_t k;
+
+	if (!w->nodes || (uintptr_t)node < first || (uintptr_t)node >= last) {
+		return;
+	}
+	k = ((uintptr_t)node - first) / w->stride;
+	if (!ck_pr_cas_uint(&w->state[k], WL_RETIRED, WL_FREE)) {
+		ck_pr_inc_64(&w->bad_reclaims);
+	}
+}
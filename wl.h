@@ -0,0 +1,142 @@
+#ifndef WL_H
+#define WL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ck_pr.h>
+
+#include "lat.h"
+#include "lf.h"
+
+/* Mixed workload over a key space shared by all threads. Key k is the node
+ * wl_node(&wl, k); the lists compare nodes by address, so a node can only be
+ * linked once at a time. Each key has a state word a thread claims before
+ * touching the list:
+ * FREE:    not linked, can be inserted
+ * BUSY:    claimed by an insert (or a delete when nodes are freed
+ *          directly) in progress
+ * IN:      linked, can be deleted (by any thread)
+ * RETIRED: deleted, waiting for the reclamation scheme to give it back
+ * An insert of a key that isn't FREE (or a delete of one that isn't IN)
+ * traverses with find instead, like a failed set operation would.
+ */
+enum wl_state {
+	WL_FREE,
+	WL_BUSY,
+	WL_IN,
+	WL_RETIRED,
+};
+
+enum wl_dist {
+	WL_UNIFORM,
+	WL_ZIPF,
+	WL_HOTSPOT,
+};
+
+struct wl_cfg {
+	uint64_t keys;
+	enum wl_dist dist;
+	/* Zipf exponent */
+	double theta;
+	/* HOTSPOT: hot_ops of all ops go to the first hot_keys of the keys */
+	double hot_keys;
+	double hot_ops;
+	uint64_t seed;
+	/* Computed by wl_cfg_prepare */
+	double zeta_n;
+	double zeta_2;
+	double alpha;
+	double eta;
+};
+
+/* Generated before the timed run so key selection costs nothing there */
+struct wl_op {
+	uint32_t key;
+	uint32_t op; /* enum lat_op */
+};
+
+struct wl {
+	/* keys nodes, stride bytes apart (the list's node size) */
+	lfhead_t *nodes;
+	size_t stride;
+	unsigned int *state;
+	uint64_t keys;
+	/* The list doesn't retire deleted nodes (lock), free them directly */
+	bool direct_free;
+	/* Reclaims of a key that wasn't RETIRED: a node retired twice, or
+	 * while it was still linked
+	 */
+	uint64_t bad_reclaims;
+};
+
+/* What a generated op turned into once its key was claimed */
+struct wl_exec {
+	lfhead_t *node;
+	enum lat_op call;
+};
+
+/* Parses "uniform", "zipf[:theta]" or "hot[:key_pct:op_pct]" */
+int wl_dist_parse(const char *str, struct wl_cfg *c);
+void wl_dist_name(const struct wl_cfg *c, char *buf, size_t len);
+void wl_cfg_prepare(struct wl_cfg *c);
+/* n ops, read_per percent finds and the rest split between inserts and
+ * deletes. stream makes each thread's sequence distinct.
+ */
+void wl_gen(const struct wl_cfg *c, uint64_t stream, uint64_t read_per,
+	    struct wl_op *ops, size_t n);
+/* Inserts of every key k with k % thrn == tidx and k % 2 == 0. Returns the
+ * number of ops written.
+ */
+size_t wl_gen_prefill(const struct wl_cfg *c, uint64_t tidx, uint64_t thrn,
+		      struct wl_op *ops);
+/* Reclaim callback: hands retired keys back. Other nodes are ignored. */
+void wl_reclaim(lfhead_t *node, void *ctx);
+
+inline static lfhead_t *wl_node(const struct wl *w, uint64_t k)
+{
+	return (lfhead_t *)(void *)((char *)w->nodes + w->stride * k);
+}
+
+inline static void wl_claim(struct wl *w, const struct wl_op *op,
+			    struct wl_exec *x)
+{
+	unsigned int *s = &w->state[op->key];
+
+	x->node = wl_node(w, op->key);
+	x->call = (enum lat_op)op->op;
+	if (x->call == LAT_INSERT) {
+		if (!ck_pr_cas_uint(s, WL_FREE, WL_BUSY)) {
+			x->call = LAT_FIND;
+		}
+	} else if (x->call == LAT_DELETE) {
+		/* RETIRED up front: the node may be reclaimed (and go back to
+		 * FREE) before the delete even returns.
+		 */
+		if (!ck_pr_cas_uint(s, WL_IN,
+				    w->direct_free ? WL_BUSY : WL_RETIRED)) {
+			x->call = LAT_FIND;
+		}
+	}
+}
+
+/* ok is what the list returned. A claimed insert or delete must succeed. */
+inline static bool wl_finish(struct wl *w, const struct wl_op *op,
+			     const struct wl_exec *x, bool ok)
+{
+	unsigned int *s = &w->state[op->key];
+
+	if (x->call == LAT_INSERT) {
+		ck_pr_store_uint(s, WL_IN);
+		return ok;
+	} else if (x->call == LAT_DELETE) {
+		if (w->direct_free) {
+			ck_pr_store_uint(s, WL_FREE);
+		}
+		return ok;
+	}
+	return true;
+}
+
+#endif /* WL_H */
@@ -1,8 +1,12 @@
+#define _GNU_SOURCE
+
 #include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <ck_pr.h>
@@ -21,7 +25,10 @@
 #define S_REM (3)
 
 #include "bench.h"
+#include "ebr.h"
 #include "lf.h"
+#include "pool.h"
+#include "smr.h"
 
 #define LFLIST_END(head_ptr, curr_ptr) (head_ptr == curr_ptr)
 
@@ -57,44 +64,126 @@ inline static bool lfhead_state_cas(lfhead_t *head, int expected, int new)
 	uintptr_t uptr_new = (uintptr_t)next_ret;
 	uptr_expected = S_SET(uptr_expected, expected);
 	uptr_new = S_SET(uptr_new, new);
-	return ck_pr_cas_ptr(&head->next_ret, (void *)uptr_expected,
-			     (void *)uptr_new);
+	return ctr_cas(ck_pr_cas_ptr(&head->next_ret, (void *)uptr_expected,
+				     (void *)uptr_new));
+}
+
+/* Unlinks the INV node curr, but only while prev isn't INV itself. prev's
+ * state and prev->next are swapped in one DWCAS, so once a node is INV its
+ * next pointer is frozen. A thread holding a stale prev can then never
+ * relink a node that was already unlinked, which makes the successful caller
+ * the only thread that saw curr leave the list and the one to retire it.
+ */
+inline static bool lfhead_snip(lfhead_t *restrict prev, lfhead_t *restrict curr,
+			       lfhead_t *restrict next)
+{
+	lfhead_t *next_ret = ck_pr_load_ptr(&prev->next_ret);
+	void *cmp[2] = { curr, next_ret };
+	void *set[2] = { next, next_ret };
+
+	if (((uintptr_t)next_ret & (uintptr_t)3) == S_INV) {
+		return false;
+	}
+	return ctr_cas(ck_pr_cas_ptr_2(prev, cmp, set));
+}
+
+/* Dummies never go through smr_retire. Each thread keeps the dummies it
+ * enlisted in a ring (oldest first, linked through prev) and reuses the
+ * oldest once it has been unlinked and an EBR grace period has passed since,
+ * the same two epochs ebr_retire waits for. linked tells entries from
+ * dummies for whoever unlinks them, and records when a dummy left the list.
+ */
+#define ZHANG_ENTRY ((uint64_t)0)
+#define ZHANG_DUMMY ((uint64_t)1)
+#define ZHANG_UNLINKED(epoch) ((uint64_t)(epoch) + 2)
+
+/* Only the thread that unlinked curr gets here */
+inline static void lfhead_unlinked(lfhead_t *curr, smr_tls_t *smr)
+{
+	uint64_t *linked = &to_zhang_node(curr)->linked;
+
+	if (ck_pr_load_64(linked) == ZHANG_ENTRY) {
+		smr_retire(smr, curr);
+		return;
+	}
+	ck_pr_fence_release();
+	ck_pr_store_64(linked,
+		       ZHANG_UNLINKED(ck_pr_load_64(&smr->ebr->dom->epoch)));
+}
+
+/* The oldest dummy of the ring if it can be reused, else a new one from the
+ * pool. Either way it goes to the back of the ring.
+ */
+inline static lfhead_t *dummy_get(thr_arg_t *arg, smr_tls_t *smr)
+{
+	lfhead_t *d = arg->dummy_first;
+	struct zhang_node *z;
+	uint64_t l;
+
+	if (d) {
+		z = to_zhang_node(d);
+		l = ck_pr_load_64(&z->linked);
+		ck_pr_fence_acquire();
+		if (l >= ZHANG_UNLINKED(0) &&
+		    ck_pr_load_64(&smr->ebr->dom->epoch) >=
+			    l - ZHANG_UNLINKED(0) + 2) {
+			arg->dummy_first = z->prev;
+		} else {
+			d = NULL;
+		}
+	}
+	if (!d) {
+		/* The pool holds a dummy per op, it never runs dry */
+		d = pool_get(arg->pool);
+	}
+	z = to_zhang_node(d);
+	z->prev = NULL;
+	z->linked = ZHANG_DUMMY;
+	if (arg->dummy_first) {
+		to_zhang_node(arg->dummy_last)->prev = d;
+	} else {
+		arg->dummy_first = d;
+	}
+	arg->dummy_last = d;
+	return d;
 }
 
 inline static void enlist(lfhead_t *restrict head, lfhead_t *restrict new)
 {
 	lfhead_t *old;
+	cm_t b = CM_INITIALIZER;
 	old = ck_pr_load_ptr(&head->next);
 	while (1) {
 		new->next = old;
-		if (ck_pr_cas_ptr_value(&head->next, old, new, &old)) {
+		if (ctr_cas(ck_pr_cas_ptr_value(&head->next, old, new, &old))) {
 			break;
 		}
+		cm_fail(&b);
 	}
 }
 
 inline static bool insert_help(lfhead_t *restrict head, lfhead_t *restrict new,
-			       hp_tls_t *restrict hp)
+			       smr_tls_t *restrict smr)
 {
 	lfhead_t *prev, *curr, *next;
 	int s;
 	prev = new;
-	curr = hp_post(hp, &new->next, HP_CURR);
+	curr = ck_pr_load_ptr(&new->next);
 
 	while (curr != head) {
+		CTR_INC(CTR_TRAVERSE);
 		s = lfhead_state_get(curr);
 
 		if (s == S_INV) {
-			next = hp_post(hp, &curr->next, HP_NEXT);
-			ck_pr_fas_ptr(&prev->next, next);
+			CTR_INC(CTR_SKIP);
+			next = ck_pr_load_ptr(&curr->next);
+			if (lfhead_snip(prev, curr, next)) {
+				lfhead_unlinked(curr, smr);
+			}
 			curr = next;
-			hp_inherit(hp, HP_NEXT, HP_CURR);
 		} else if (curr != new) {
 			prev = curr;
-			hp_inherit(hp, HP_CURR, HP_PREV);
-			next = hp_post(hp, &curr->next, HP_NEXT);
-			curr = next;
-			hp_inherit(hp, HP_NEXT, HP_CURR);
+			curr = ck_pr_load_ptr(&curr->next);
 		} else if (s == S_REM) {
 			return true;
 		} else if (s == S_INS || s == S_DAT) {
@@ -106,35 +195,36 @@ inline static bool insert_help(lfhead_t *restrict head, lfhead_t *restrict new,
 }
 
 inline static bool del_help(lfhead_t *restrict head, lfhead_t *restrict target,
-			    lfhead_t *restrict dummy,
-			    hp_tls_t *restrict hp)
+			    lfhead_t *restrict dummy, smr_tls_t *restrict smr)
 {
 	lfhead_t *prev, *curr, *next;
 	int s;
 	prev = dummy;
-	curr = hp_post(hp, &dummy->next, HP_CURR);
+	curr = ck_pr_load_ptr(&dummy->next);
 
 	while (curr != head) {
+		CTR_INC(CTR_TRAVERSE);
 		s = lfhead_state_get(curr);
 
 		if (s == S_INV) {
-			next = hp_post(hp, &curr->next, HP_NEXT);
-			ck_pr_fas_ptr(&prev->next, next);
+			CTR_INC(CTR_SKIP);
+			next = ck_pr_load_ptr(&curr->next);
+			if (lfhead_snip(prev, curr, next)) {
+				lfhead_unlinked(curr, smr);
+			}
 			curr = next;
-			hp_inherit(hp, HP_NEXT, HP_CURR);
 		} else if (curr != target) {
 			prev = curr;
-			hp_inherit(hp, HP_CURR, HP_PREV);
-			next = hp_post(hp, &curr->next, HP_NEXT);
-			curr = next;
-			hp_inherit(hp, HP_NEXT, HP_CURR);
+			curr = ck_pr_load_ptr(&curr->next);
 		} else if (s == S_REM) {
 			return false;
 		} else if (s == S_INS) {
 			return lfhead_state_cas(curr, S_INS, S_REM);
 		} else if (s == S_DAT) {
-			lfhead_state_fas(curr, S_INV);
-			return true;
+			/* A plain store could land after another deleter already
+			 * invalidated, unlinked and retired curr.
+			 */
+			return lfhead_state_cas(curr, S_DAT, S_INV);
 		}
 	}
 
@@ -142,129 +232,584 @@ inline static bool del_help(lfhead_t *restrict head, lfhead_t *restrict target,
 }
 
 inline static bool insert(lfhead_t *restrict head, lfhead_t *restrict new,
-			  hp_tls_t *restrict hp)
+			  smr_tls_t *restrict smr)
 {
 	bool b = true;
+
+	smr_begin(smr);
+	to_zhang_node(new)->linked = ZHANG_ENTRY;
 	lfhead_state_set(new, S_INS);
-	/* I don't think we need to set new as a hazard pointer due to the
-	 * similar reasons as del with dummy. If we are the only thread that
-	 * can actually mark it S_INV (if the cas fails) then it will never
-	 * be moved to the retire list.
+	/* Nobody but us can move new to S_INV while it is S_INS, so it can't be
+	 * unlinked before insert_help walks past it.
 	 */
 	enlist(head, new);
 
-	b = insert_help(head, new, hp);
+	b = insert_help(head, new, smr);
 
 	if (!lfhead_state_cas(new, S_INS, b ? S_DAT : S_INV)) {
-		del_help(head, new, new, hp);
+		del_help(head, new, new, smr);
 		lfhead_state_fas(new, S_INV);
 	}
-	hp_clear(hp);
+	smr_end(smr);
 	return b;
 }
 
+/* For callers that never insert a node that is already in the list, like
+ * intrusive ones where every node goes in once: no duplicate check, so no
+ * walk. new still goes through S_INS, which keeps it from counting as
+ * present (member()) before the enlist CAS. A del_help that finds it there
+ * moves it to S_REM, the same as during a full insert, and we lose the CAS
+ * below: the delete came after our insert, so both succeeded.
+ */
+inline static bool insert_nodup(lfhead_t *restrict head,
+				lfhead_t *restrict new, smr_tls_t *restrict smr)
+{
+	smr_begin(smr);
+	to_zhang_node(new)->linked = ZHANG_ENTRY;
+	lfhead_state_set(new, S_INS);
+	enlist(head, new);
+	if (!lfhead_state_cas(new, S_INS, S_DAT)) {
+		lfhead_state_fas(new, S_INV);
+	}
+	smr_end(smr);
+	return true;
+}
+
 inline static bool del(lfhead_t *restrict head, lfhead_t *restrict target,
-		       lfhead_t *restrict dummy, lfhead_t *restrict head_ret,
-		       hp_tls_t *restrict hp)
+		       lfhead_t *restrict dummy, smr_tls_t *restrict smr)
 {
 	bool b;
 
+	smr_begin(smr);
 	lfhead_state_set(dummy, S_REM);
-	/* Dummy will be visible in the list after this operation, but I don't think
-	 * we need a hazard pointer for it. The only thread that is allowed to switch
-	 * a node from S_REM to S_INV is the "owner" of that node. If the node cannot
-	 * be logically deleted during the lifetime of this call then it will never
-	 * go on the retire list.
+	/* Same as new in insert: only we can invalidate the dummy, so it stays
+	 * linked until we are done with it.
 	 */
 	enlist(head, dummy);
 
-	b = del_help(head, target, dummy, hp);
-	hp_clear(hp);
+	b = del_help(head, target, dummy, smr);
 	lfhead_state_fas(dummy, S_INV);
+	smr_end(smr);
 
-	/* THIS IS NOT CORRECT!!!! ONLY DOING THIS FOR BENCHMARK TO SEE
-	 * WHAT IF
+	/* target and dummy are now INV. Whoever unlinks target retires it,
+	 * dummy goes back to our ring.
 	 */
-	if (b) {
-		retire_push(head_ret, target);
-		retire_push(head_ret, dummy);
-	}
-
 	return b;
 }
 
 inline static bool find(lfhead_t *restrict head, lfhead_t *restrict target,
-			hp_tls_t *restrict hp)
+			smr_tls_t *restrict smr)
 {
 	bool result = false;
-	lfhead_t *next, *curr, *prev;
+	lfhead_t *curr;
 	int s;
 
-	prev = head;
-	curr = hp_post(hp, &head->next, HP_CURR);
+	smr_begin(smr);
+	curr = ck_pr_load_ptr(&head->next);
 
 	while (curr != head) {
+		CTR_INC(CTR_TRAVERSE);
 		s = lfhead_state_get(curr);
 		if (curr == target) {
 			result = s != S_INV && s != S_REM;
 			break;
 		}
+		curr = ck_pr_load_ptr(&curr->next);
+	}
+	smr_end(smr);
+	return result;
+}
+
+/* O(1) membership: DAT is set only once target is linked and its insert has
+ * won, INV/REM only once a delete has. INS can't tell whether the enlist CAS
+ * already happened, so only then do we look for target in the list.
+ */
+inline static bool member(lfhead_t *restrict head, lfhead_t *restrict target,
+			  smr_tls_t *restrict smr)
+{
+	int s = lfhead_state_get(target);
+
+	ck_pr_fence_acquire();
+	if (s == S_INS) {
+		return find(head, target, smr);
+	}
+	return s == S_DAT;
+}
+
+/* Cooperative compaction: walks from head and unlinks up to n INV nodes the
+ * same way the helpers do. Returns how many it unlinked. head has to be
+ * DAT (zhang_setup), an INV prev never gets to unlink.
+ */
+static uint64_t zhang_compact(lfhead_t *head, uint64_t n, smr_tls_t *smr)
+{
+	lfhead_t *prev, *curr, *next;
+	uint64_t unlinked = 0;
+
+	smr_begin(smr);
+	prev = head;
+	curr = ck_pr_load_ptr(&head->next);
+	while (curr != head && unlinked < n) {
+		next = ck_pr_load_ptr(&curr->next);
+		if (lfhead_state_get(curr) == S_INV) {
+			if (lfhead_snip(prev, curr, next)) {
+				lfhead_unlinked(curr, smr);
+				++unlinked;
+			}
+		} else {
+			prev = curr;
+		}
+		curr = next;
+	}
+	smr_end(smr);
+	return unlinked;
+}
+
+/* A snapshot, concurrent operations move nodes between the two */
+void zhang_gauge(thr_arg_t *arg, uint64_t *live, uint64_t *inv)
+{
+	lfhead_t *head = arg->head;
+	lfhead_t *curr = ck_pr_load_ptr(&head->next);
+
+	*live = 0;
+	*inv = 0;
+	while (curr != head) {
+		if (lfhead_state_get(curr) == S_INV) {
+			++*inv;
+		} else {
+			++*live;
+		}
+		curr = ck_pr_load_ptr(&curr->next);
+	}
+}
+
+/* Wait-free variant (the paper's section on wait-freedom). Every traversal
+ * is bounded by the list as it was when the operation's own node went in,
+ * so the one unbounded loop left is the enlist CAS. zwf enlists at the tail
+ * instead, with Kogan & Petrank's wait-free queue: a thread takes a phase,
+ * announces its node and helps every announced enlist of an older or equal
+ * phase (its own included) before it returns. Once a node is announced,
+ * every thread that starts an enlist later helps it first, so it is linked
+ * within a bounded number of steps.
+ *
+ * The list is then in enlist order from head, so the helpers walk from head
+ * up to their own node rather than from it to the end. The last node is
+ * never unlinked (appends CAS its next) and neither is the one tail points
+ * at, or tail could be left on a reclaimed node. The node's tid records
+ * which thread enlisted it.
+ */
+#define ZWF_PENDING ((uint64_t)1)
+
+struct zwf_ann {
+	lfhead_t *node;
+	/* phase << 1 | ZWF_PENDING, swapped together with node */
+	uint64_t phase;
+} __attribute__((aligned(CACHELINE_BYTES)));
+
+static struct {
+	lfhead_t *tail __attribute__((aligned(CACHELINE_BYTES)));
+	uint64_t phase __attribute__((aligned(CACHELINE_BYTES)));
+	struct zwf_ann *ann;
+	uint64_t ann_num;
+} zwf;
+
+inline static bool zwf_pending(uint64_t tid, uint64_t phase)
+{
+	uint64_t p = ck_pr_load_64(&zwf.ann[tid].phase);
+
+	return (p & ZWF_PENDING) && (p >> 1) <= phase;
+}
+
+/* Completes the append tail is behind on: clears its announcement, then
+ * moves tail forward.
+ */
+static void zwf_finish(lfhead_t *head)
+{
+	lfhead_t *last = ck_pr_load_ptr(&zwf.tail);
+	lfhead_t *next = ck_pr_load_ptr(&last->next);
+	struct zwf_ann *a;
+	void *cmp[2], *set[2];
+
+	if (next == head) {
+		return;
+	}
+	a = &zwf.ann[to_zhang_node(next)->tid];
+	cmp[1] = (void *)(uintptr_t)ck_pr_load_64(&a->phase);
+	cmp[0] = ck_pr_load_ptr(&a->node);
+	if (last == ck_pr_load_ptr(&zwf.tail) && cmp[0] == next &&
+	    ((uintptr_t)cmp[1] & ZWF_PENDING)) {
+		set[0] = next;
+		set[1] = (void *)((uintptr_t)cmp[1] & ~ZWF_PENDING);
+		ctr_cas(ck_pr_cas_ptr_2(a, cmp, set));
+	}
+	ctr_cas(ck_pr_cas_ptr(&zwf.tail, last, next));
+}
+
+static void zwf_help_enlist(lfhead_t *head, uint64_t tid, uint64_t phase)
+{
+	lfhead_t *last, *next;
+
+	while (zwf_pending(tid, phase)) {
+		last = ck_pr_load_ptr(&zwf.tail);
+		next = ck_pr_load_ptr(&last->next);
+		if (last != ck_pr_load_ptr(&zwf.tail)) {
+			continue;
+		}
+		if (next != head) {
+			zwf_finish(head);
+			continue;
+		}
+		/* last->next is only head while last is the end, so this can't
+		 * link the node a second time.
+		 */
+		if (zwf_pending(tid, phase) &&
+		    ctr_cas(ck_pr_cas_ptr(&last->next, head,
+					  ck_pr_load_ptr(&zwf.ann[tid].node)))) {
+			zwf_finish(head);
+			return;
+		}
+	}
+}
+
+static void zwf_enlist(lfhead_t *head, lfhead_t *new, uint64_t tid)
+{
+	uint64_t phase = ck_pr_faa_64(&zwf.phase, 1);
+	struct zwf_ann *a = &zwf.ann[tid];
+
+	new->next = head;
+	to_zhang_node(new)->tid = tid;
+	ck_pr_store_ptr(&a->node, new);
+	ck_pr_fence_store();
+	ck_pr_store_64(&a->phase, (phase << 1) | ZWF_PENDING);
+	ck_pr_fence_memory();
+	for (uint64_t t = 0; t < zwf.ann_num; ++t) {
+		zwf_help_enlist(head, t, phase);
+	}
+	zwf_finish(head);
+}
+
+/* next has to be read before tail: once curr has a successor, tail is on
+ * curr or past it for good.
+ */
+inline static bool zwf_snip(lfhead_t *head, lfhead_t *prev, lfhead_t *curr,
+			    lfhead_t *next)
+{
+	if (next == head || curr == ck_pr_load_ptr(&zwf.tail)) {
+		return false;
+	}
+	return lfhead_snip(prev, curr, next);
+}
+
+/* Walks from head to new, unlinking INV nodes. Nodes are told apart by
+ * address, so nothing before new can be a duplicate of it.
+ */
+static void zwf_insert_help(lfhead_t *head, lfhead_t *new, smr_tls_t *smr)
+{
+	lfhead_t *prev = head;
+	lfhead_t *curr = ck_pr_load_ptr(&head->next);
+	lfhead_t *next;
+
+	while (curr != new) {
+		CTR_INC(CTR_TRAVERSE);
+		next = ck_pr_load_ptr(&curr->next);
+		if (lfhead_state_get(curr) == S_INV) {
+			CTR_INC(CTR_SKIP);
+			if (zwf_snip(head, prev, curr, next)) {
+				lfhead_unlinked(curr, smr);
+			}
+		} else {
+			prev = curr;
+		}
+		curr = next;
+	}
+}
+
+/* Same decisions as del_help, on the nodes between head and dummy */
+static bool zwf_del_help(lfhead_t *head, lfhead_t *target, lfhead_t *dummy,
+			 smr_tls_t *smr)
+{
+	lfhead_t *prev = head;
+	lfhead_t *curr = ck_pr_load_ptr(&head->next);
+	lfhead_t *next;
+	int s;
+
+	while (curr != dummy) {
+		CTR_INC(CTR_TRAVERSE);
+		next = ck_pr_load_ptr(&curr->next);
+		s = lfhead_state_get(curr);
+		if (s == S_INV) {
+			CTR_INC(CTR_SKIP);
+			if (zwf_snip(head, prev, curr, next)) {
+				lfhead_unlinked(curr, smr);
+			}
+			curr = next;
+			continue;
+		}
+		if (curr == target) {
+			if (s == S_INS) {
+				return lfhead_state_cas(curr, S_INS, S_REM);
+			}
+			if (s == S_DAT) {
+				return lfhead_state_cas(curr, S_DAT, S_INV);
+			}
+			return false;
+		}
 		prev = curr;
-		hp_inherit(hp, HP_CURR, HP_PREV);
-		next = hp_post(hp, &curr->next, HP_NEXT);
 		curr = next;
-		hp_inherit(hp, HP_NEXT, HP_CURR);
 	}
-	hp_clear(hp);
-	return result;
+	/* Enlisted after our dummy, so it wasn't there when we started */
+	return false;
 }
 
-void *zhang_trfunc(void *varg)
+static bool zwf_insert(lfhead_t *head, lfhead_t *new, uint64_t tid,
+		       smr_tls_t *smr)
+{
+	smr_begin(smr);
+	to_zhang_node(new)->linked = ZHANG_ENTRY;
+	lfhead_state_set(new, S_INS);
+	zwf_enlist(head, new, tid);
+	zwf_insert_help(head, new, smr);
+	if (!lfhead_state_cas(new, S_INS, S_DAT)) {
+		/* A delete found it first, it went after us */
+		lfhead_state_fas(new, S_INV);
+	}
+	smr_end(smr);
+	return true;
+}
+
+static bool zwf_del(lfhead_t *head, lfhead_t *target, lfhead_t *dummy,
+		    uint64_t tid, smr_tls_t *smr)
+{
+	bool b;
+
+	smr_begin(smr);
+	lfhead_state_set(dummy, S_REM);
+	zwf_enlist(head, dummy, tid);
+	b = zwf_del_help(head, target, dummy, smr);
+	lfhead_state_fas(dummy, S_INV);
+	smr_end(smr);
+	return b;
+}
+
+enum zhang_mode {
+	ZHANG_LF,
+	ZHANG_NODUP,
+	ZHANG_WF,
+};
+
+inline static bool zhang_insert(lfhead_t *restrict head,
+				lfhead_t *restrict new, enum zhang_mode mode,
+				uint64_t tid, smr_tls_t *restrict smr)
+{
+	switch (mode) {
+	case ZHANG_NODUP:
+		return insert_nodup(head, new, smr);
+	case ZHANG_WF:
+		return zwf_insert(head, new, tid, smr);
+	case ZHANG_LF:
+	default:
+		return insert(head, new, smr);
+	}
+}
+
+inline static bool zhang_del(thr_arg_t *arg, lfhead_t *target,
+			     enum zhang_mode mode, smr_tls_t *smr)
+{
+	lfhead_t *dummy = dummy_get(arg, smr);
+
+	if (mode == ZHANG_WF) {
+		return zwf_del(arg->head, target, dummy, arg->tidx, smr);
+	}
+	return del(arg->head, target, dummy, smr);
+}
+
+static void *zhang_run(void *varg, enum zhang_mode mode)
 {
 	BENCH_DECOMPOSE_ARGS(varg);
+	smr_tls_t *smr = &smr_tls;
+
+	smr_thread_start(smr);
+
+	if (wl) {
+		wl_foreach(op)
+		{
+			struct wl_exec x;
+			bool ok = true;
+
+			wl_claim(wl, op, &x);
+			switch (x.call) {
+			case LAT_INSERT:
+				LAT_TIMED(lat, LAT_INSERT,
+					  ok = zhang_insert(head, x.node, mode,
+							    arg->tidx, smr));
+				break;
+			case LAT_DELETE:
+				LAT_TIMED(lat, LAT_DELETE,
+					  ok = zhang_del(arg, x.node, mode,
+							 smr));
+				break;
+			case LAT_FIND:
+			case LAT_OP_NUM:
+			default:
+				LAT_TIMED(lat, (enum lat_op)op->op,
+					  member(head, x.node, smr));
+				break;
+			}
+			if (!wl_finish(wl, op, &x, ok)) {
+				++arg->wl_errors;
+			}
+		}
+		smr_thread_stop(smr);
+		pthread_exit(NULL);
+	}
+
 	insert_phase_foreach(i)
 	{
-		insert(head, &nodes[i], hp_tls);
+		LAT_TIMED(lat, LAT_INSERT,
+			  zhang_insert(head, phase_node(i), mode, arg->tidx,
+				       smr));
 	}
 	find_phase_foreach(i)
 	{
-		find(head, &nodes[i], hp_tls);
+		LAT_TIMED(lat, LAT_FIND, member(head, phase_node(i), smr));
 	}
 	delete_phase_foreach(i)
 	{
-		del(head, &nodes[i], &dummies[i], head_ret, hp_tls);
+		LAT_TIMED(lat, LAT_DELETE,
+			  zhang_del(arg, phase_node(i), mode, smr));
 	}
 
 	all_phase_foreach(i)
 	{
-		insert(head, &nodes[i], hp_tls);
-		find(head, &nodes[i], hp_tls);
-		del(head, &nodes[i], &dummies[i], head_ret, hp_tls);
+		LAT_TIMED(lat, LAT_INSERT,
+			  zhang_insert(head, phase_node(i), mode, arg->tidx,
+				       smr));
+		LAT_TIMED(lat, LAT_FIND, member(head, phase_node(i), smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  zhang_del(arg, phase_node(i), mode, smr));
 	}
 	finish_find_phase_foreach()
 	{
-		find(head, &nodes[rops], hp_tls);
+		LAT_TIMED(lat, LAT_FIND, member(head, phase_node(rops), smr));
 	}
 	finish_insdel_phase_foreach(i)
 	{
-		insert(head, &nodes[i], hp_tls);
-		del(head, &nodes[i], &dummies[i], head_ret, hp_tls);
+		LAT_TIMED(lat, LAT_INSERT,
+			  zhang_insert(head, phase_node(i), mode, arg->tidx,
+				       smr));
+		LAT_TIMED(lat, LAT_DELETE,
+			  zhang_del(arg, phase_node(i), mode, smr));
 	}
+	smr_thread_stop(smr);
 	pthread_exit(NULL);
 }
 
+void *zhang_trfunc(void *varg)
+{
+	return zhang_run(varg, ZHANG_LF);
+}
+
+void *zhang_nodup_trfunc(void *varg)
+{
+	return zhang_run(varg, ZHANG_NODUP);
+}
+
+void *zhang_wf_trfunc(void *varg)
+{
+	return zhang_run(varg, ZHANG_WF);
+}
+
+/* Optional janitor that keeps compacting the list while a run goes on, on
+ * the spare EBR record the bench keeps for it.
+ */
+static struct {
+	pthread_t tid;
+	lfhead_t *head;
+	smr_tls_t smr;
+	uint64_t batch;
+	unsigned int stop;
+	bool running;
+} janitor;
+
+static void *zhang_janitor(void *varg)
+{
+	(void)varg;
+	smr_thread_start(&janitor.smr);
+	while (!ck_pr_load_uint(&janitor.stop)) {
+		if (zhang_compact(janitor.head, janitor.batch, &janitor.smr) ==
+		    0) {
+			/* Nothing left, leave the core to the workers */
+			sched_yield();
+		}
+	}
+	smr_thread_stop(&janitor.smr);
+	return NULL;
+}
+
+/* Runs before any thread starts, after the last run's cleanup unlinked
+ * every dummy, so the rings can go back to the pool whole.
+ */
+static void zhang_reset(thr_arg_t *args, uint64_t thrn)
+{
+	lfhead_t *d;
+
+	for (uint64_t t = 0; t < thrn; ++t) {
+		while ((d = args[t].dummy_first)) {
+			args[t].dummy_first = to_zhang_node(d)->prev;
+			pool_put(args[t].pool->dom, d);
+		}
+		args[t].dummy_last = NULL;
+	}
+	/* The nodes right behind head can only be unlinked through it */
+	lfhead_state_set(args[0].head, S_DAT);
+}
+
+int zhang_setup(thr_arg_t *args, uint64_t thrn)
+{
+	zhang_reset(args, thrn);
+	if (!args[0].compact) {
+		return 0;
+	}
+	janitor.head = args[0].head;
+	janitor.smr.mode = args[0].smr_mode;
+	janitor.smr.hp = NULL;
+	janitor.smr.ebr = ebr_register(args[0].ebr_tls->dom);
+	janitor.smr.he = NULL;
+	janitor.batch = args[0].compact;
+	janitor.stop = 0;
+	if (!janitor.smr.ebr) {
+		return -1;
+	}
+	if (pthread_create(&janitor.tid, NULL, zhang_janitor, NULL) != 0) {
+		ebr_unregister(janitor.smr.ebr);
+		return -1;
+	}
+	janitor.running = true;
+	return 0;
+}
+
 void zhang_cleanup(thr_arg_t *arg)
 {
+	smr_tls_t smr = { arg->smr_mode, arg->hp_tls, arg->ebr_tls,
+			  arg->he_tls };
 	lfhead_t *prev, *curr, *next;
 	int s;
+
+	if (janitor.running) {
+		ck_pr_store_uint(&janitor.stop, 1);
+		pthread_join(janitor.tid, NULL);
+		ebr_unregister(janitor.smr.ebr);
+		janitor.running = false;
+	}
 	prev = arg->head;
 	curr = ck_pr_load_ptr(&prev->next);
 
+	/* Runs after join, but the caller's record is still registered */
 	while (curr != arg->head) {
 		s = lfhead_state_get(curr);
 		if (s == S_INV) {
 			next = ck_pr_load_ptr(&curr->next);
 			ck_pr_fas_ptr(&prev->next, next);
+			lfhead_unlinked(curr, &smr);
 			curr = next;
 			continue;
 		}
@@ -272,3 +817,32 @@ void zhang_cleanup(thr_arg_t *arg)
 		curr = ck_pr_load_ptr(&curr->next);
 	}
 }
+
+/* The janitor's snips don't know about tail, so -J is ignored here */
+int zhang_wf_setup(thr_arg_t *args, uint64_t thrn)
+{
+	lfhead_t *last = args[0].head;
+
+	zhang_reset(args, thrn);
+	while (last->next != args[0].head) {
+		last = last->next;
+	}
+	zwf.tail = last;
+	zwf.phase = 0;
+	zwf.ann = aligned_alloc(CACHELINE_BYTES, sizeof(*zwf.ann) * thrn);
+	if (!zwf.ann) {
+		return -1;
+	}
+	memset(zwf.ann, 0, sizeof(*zwf.ann) * thrn);
+	zwf.ann_num = thrn;
+	return 0;
+}
+
+/* tail may be left on a node unlinked here, setup finds the end again */
+void zhang_wf_cleanup(thr_arg_t *arg)
+{
+	free(zwf.ann);
+	zwf.ann = NULL;
+	zwf.ann_num = 0;
+	zhang_cleanup(arg);
+}
@@ -9,6 +9,11 @@
 
 #include <pf_hw_timer.h>
 
+#include "ebr.h"
+#include "lf.h"
+#include "pool.h"
+#include "tsc.h"
+
 #define S_DAT (0)
 #define S_INV (1)
 #define S_INS (2)
@@ -19,13 +24,9 @@
  * V2: State kept in 2 lower pointer bits ~17-23ms
  */
 
-struct lflist_head {
-	struct lflist_head *next;
-};
-typedef struct lflist_head lflist_head_t;
-
+/* next carries the state bits, next_ret is only used once retired */
 struct integer_entry {
-	lflist_head_t integers;
+	lfhead_t integers;
 	int x;
 };
 
@@ -57,13 +58,11 @@ struct integer_entry {
 
 #define LFLIST_END(head_ptr, curr_ptr) (head_ptr == curr_ptr)
 
-#define lflist_entry(lflist_head_ptr, entry_type, entry_lflist_head_member) \
-	((entry_type *)((uintptr_t)(lflist_head_ptr) -                      \
-			offsetof(entry_type, entry_lflist_head_member)))
+#define NTS (8)
 
-inline static void enlist_ins(struct lflist_head *head, struct lflist_head *new)
+inline static void enlist_ins(lfhead_t *head, lfhead_t *new)
 {
-	struct lflist_head *old;
+	lfhead_t *old;
 	old = ck_pr_load_ptr(&head->next);
 	while (1) {
 		new->next = PTR_SET_INS(old);
@@ -73,9 +72,9 @@ inline static void enlist_ins(struct lflist_head *head, struct lflist_head *new)
 	}
 }
 
-inline static void enlist_del(struct lflist_head *head, struct lflist_head *new)
+inline static void enlist_del(lfhead_t *head, lfhead_t *new)
 {
-	struct lflist_head *old;
+	lfhead_t *old;
 	old = ck_pr_load_ptr(&head->next);
 	while (1) {
 		new->next = PTR_SET_REM(old);
@@ -85,13 +84,54 @@ inline static void enlist_del(struct lflist_head *head, struct lflist_head *new)
 	}
 }
 
-inline static bool insert_help(struct lflist_head *head,
-			       struct lflist_head *new)
+/* The pointer half of node->next moves whenever the node behind it gets
+ * unlinked, so state changes have to loop instead of storing a value built
+ * from an earlier load (that could relink an unlinked node).
+ */
+inline static bool state_cas(lfhead_t *node, uintptr_t expected, uintptr_t new)
+{
+	void *raw = ck_pr_load_ptr(&node->next);
+
+	while (PTR_GET_STATE(raw) == expected) {
+		if (ck_pr_cas_ptr_value(&node->next, raw,
+					PTR_SET_STATE(raw, new), &raw)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline static void state_fas(lfhead_t *node, uintptr_t new)
+{
+	void *raw = ck_pr_load_ptr(&node->next);
+
+	while (!ck_pr_cas_ptr_value(&node->next, raw, PTR_SET_STATE(raw, new),
+				    &raw))
+		;
+}
+
+/* prev->next carries prev's state, so this fails once prev is INV. INV
+ * nodes therefore have a frozen next pointer and a stale prev can't relink
+ * a node that is already gone. The caller that succeeds is the only one to
+ * unlink curr and retires it.
+ */
+inline static bool snip(lfhead_t *prev, lfhead_t *curr, lfhead_t *next)
+{
+	void *raw = ck_pr_load_ptr(&prev->next);
+	uintptr_t s = PTR_GET_STATE(raw);
+
+	if (s == STATE_INV || PTR_SET_DAT(raw) != curr) {
+		return false;
+	}
+	return ck_pr_cas_ptr(&prev->next, raw, PTR_SET_STATE(next, s));
+}
+
+inline static bool insert_help(lfhead_t *head, lfhead_t *new, ebr_tls_t *ebr)
 {
-	struct lflist_head *prev, *curr, *next;
+	lfhead_t *prev, *curr, *next;
 	void *curr_raw;
 	uintptr_t s;
-	prev = PTR_SET_DAT(new);
+	prev = new;
 	curr_raw = ck_pr_load_ptr(&prev->next);
 	curr = PTR_SET_DAT(curr_raw);
 
@@ -100,9 +140,11 @@ inline static bool insert_help(struct lflist_head *head,
 		s = PTR_GET_STATE(next);
 
 		if (s == S_INV) {
-			ck_pr_fas_ptr(&prev->next, next);
-			curr_raw = next;
-			curr = PTR_SET_DAT(curr_raw);
+			next = PTR_SET_DAT(next);
+			if (snip(prev, curr, next)) {
+				ebr_retire(ebr, curr);
+			}
+			curr = next;
 		} else if (curr != new) {
 			prev = curr;
 			curr_raw = ck_pr_load_ptr(&curr->next);
@@ -117,14 +159,13 @@ inline static bool insert_help(struct lflist_head *head,
 	return true;
 }
 
-inline static bool del_help(struct lflist_head *head,
-			    struct lflist_head *target,
-			    struct lflist_head *dummy)
+inline static bool del_help(lfhead_t *head, lfhead_t *target, lfhead_t *dummy,
+			    ebr_tls_t *ebr)
 {
-	struct lflist_head *prev, *curr, *next;
+	lfhead_t *prev, *curr, *next;
 	void *curr_raw;
 	uintptr_t s;
-	prev = PTR_SET_DAT(dummy);
+	prev = dummy;
 	curr_raw = ck_pr_load_ptr(&prev->next);
 	curr = PTR_SET_DAT(curr_raw);
 
@@ -133,9 +174,11 @@ inline static bool del_help(struct lflist_head *head,
 		s = PTR_GET_STATE(next);
 
 		if (s == S_INV) {
-			ck_pr_fas_ptr(&prev->next, next);
-			curr_raw = next;
-			curr = PTR_SET_DAT(curr_raw);
+			next = PTR_SET_DAT(next);
+			if (snip(prev, curr, next)) {
+				ebr_retire(ebr, curr);
+			}
+			curr = next;
 		} else if (curr != target) {
 			prev = curr;
 			curr_raw = ck_pr_load_ptr(&curr->next);
@@ -143,57 +186,92 @@ inline static bool del_help(struct lflist_head *head,
 		} else if (s == S_REM) {
 			return false;
 		} else if (s == S_INS) {
-			return ck_pr_cas_ptr(&curr->next, next, PTR_SET_REM(next));
+			return state_cas(curr, STATE_INS, STATE_REM);
 		} else if (s == S_DAT) {
-			ck_pr_fas_ptr(&curr->next, PTR_SET_INV(next));
-			return true;
+			return state_cas(curr, STATE_DAT, STATE_INV);
 		}
 	}
 
 	return true;
 }
 
-inline static bool insert(struct lflist_head *restrict head,
-			  struct lflist_head *restrict new)
+inline static bool insert(lfhead_t *restrict head, lfhead_t *restrict new,
+			  ebr_tls_t *restrict ebr)
 {
 	bool b = true;
-	struct lflist_head *new_orig = PTR_SET_DAT(new);
-	void *ins_state_ptr;
-	void *new_state_ptr;
 
+	ebr_enter(ebr);
 	enlist_ins(head, new);
-	ins_state_ptr = PTR_SET_INS(new_orig->next);
 
-	b = insert_help(head, new);
+	b = insert_help(head, new, ebr);
 
-	new_state_ptr = b ? PTR_SET_DAT(new_orig->next) : PTR_SET_INV(new_orig->next);
-	if (!ck_pr_cas_ptr(&new_orig->next, ins_state_ptr, new_state_ptr)) {
-		del_help(head, new, new);
-		ck_pr_fas_ptr(&new_orig->next, PTR_SET_INV(new_orig->next));
+	if (!state_cas(new, STATE_INS, b ? STATE_DAT : STATE_INV)) {
+		del_help(head, new, new, ebr);
+		state_fas(new, STATE_INV);
 	}
+	ebr_exit(ebr);
 	return b;
 }
 
-inline static bool del(struct lflist_head *restrict head,
-		       struct lflist_head *restrict target,
-		       struct lflist_head *restrict dummy)
+inline static bool del(lfhead_t *restrict head, lfhead_t *restrict target,
+		       lfhead_t *restrict dummy, ebr_tls_t *restrict ebr)
 {
 	bool b;
-	struct lflist_head *dummy_orig = PTR_SET_DAT(dummy);
 
+	ebr_enter(ebr);
 	enlist_del(head, dummy);
 
-	b = del_help(head, target, dummy);
-	ck_pr_fas_ptr(&dummy_orig->next, PTR_SET_INV(dummy_orig->next));
+	b = del_help(head, target, dummy, ebr);
+	state_fas(dummy, STATE_INV);
+	ebr_exit(ebr);
 
 	return b;
 }
 
-static void _integer_list_print(struct lflist_head *head)
+inline static bool find(lfhead_t *restrict head, lfhead_t *restrict target,
+			ebr_tls_t *restrict ebr)
+{
+	bool result = false;
+	void *curr_raw;
+	lfhead_t *curr;
+	uintptr_t s;
+
+	ebr_enter(ebr);
+	curr_raw = ck_pr_load_ptr(&head->next);
+	curr = PTR_SET_DAT(curr_raw);
+	while (curr != head) {
+		curr_raw = ck_pr_load_ptr(&curr->next);
+		if (curr == target) {
+			s = PTR_GET_STATE(curr_raw);
+			result = s != S_INV && s != S_REM;
+			break;
+		}
+		curr = PTR_SET_DAT(curr_raw);
+	}
+	ebr_exit(ebr);
+	return result;
+}
+
+/* O(1) unless target is INS, which enlist_ins sets before its CAS links
+ * target, so only then does it take a walk to tell.
+ */
+inline static bool member(lfhead_t *restrict head, lfhead_t *restrict target,
+			  ebr_tls_t *restrict ebr)
+{
+	uintptr_t s = PTR_GET_STATE(ck_pr_load_ptr(&target->next));
+
+	ck_pr_fence_acquire();
+	if (s == S_INS) {
+		return find(head, target, ebr);
+	}
+	return s == S_DAT;
+}
+
+static void _integer_list_print(lfhead_t *head)
 {
 	void *curr_raw = ck_pr_load_ptr(&head->next);
-	struct lflist_head *curr = PTR_SET_DAT(curr_raw);
-	struct lflist_head *next;
+	lfhead_t *curr = PTR_SET_DAT(curr_raw);
+	lfhead_t *next;
 	int i = 1;
 
 	printf("[0]: %p\n", head);
@@ -218,35 +296,58 @@ static void _integer_list_print(struct lflist_head *head)
 	}
 }
 
+#define LEN (16000)
+
+static ebr_tls_t ebrs[NTS];
+static ebr_domain_t ebr_dom;
+/* Entries embed their lfhead_t first, so entries and dummies share a pool
+ * and reclaimed ones go back to the thread that carved them.
+ */
+static pool_tls_t pools[NTS];
+static pool_domain_t pool_dom;
+
 static void *pthread_runner(void *arg)
 {
-	struct lflist_head *head = (struct lflist_head *)arg;
+	lfhead_t *head = (lfhead_t *)arg;
+	ebr_tls_t *ebr = ebr_register(&ebr_dom);
+	pool_tls_t *pool = pool_register(&pool_dom);
 	int i;
 
-#define LEN (16000)
-	struct integer_entry *es = malloc(sizeof(*es) * LEN);
-	struct lflist_head *dummies = malloc(sizeof(*dummies) * LEN);
-
 	for (i = 0; i < LEN; ++i) {
-		es[i].x = i;
-		insert(head, &es[i].integers);
-		del(head, &es[i].integers, &dummies[i]);
+		struct integer_entry *e = pool_get(pool);
+		lfhead_t *dummy = pool_get(pool);
+
+		e->x = i;
+		insert(head, &e->integers, ebr);
+		if (!member(head, &e->integers, ebr)) {
+			fprintf(stderr, "Lost entry %d\n", i);
+		}
+		del(head, &e->integers, dummy, ebr);
 	}
+	pool_unregister(pool);
+	ebr_unregister(ebr);
 	pthread_exit(NULL);
-#undef LEN
 }
 
 int main(void)
 {
-	lflist_head_t head;
+	lfhead_t head;
 	head.next = &head;
 	char buf[128];
-#define NTS (8)
 	pthread_t tids[NTS];
+	uint64_t reclaimed, pending;
 
-	struct pf_hw_timer timer;
+	struct tsc_timer timer;
 
-	pf_hw_timer_start(&timer);
+	/* Worst case nothing is reclaimed until the end */
+	if (pool_domain_init(&pool_dom, pools, NTS, sizeof(struct integer_entry),
+			     2 * LEN, false) != 0) {
+		printf("Failed to reserve the node pool\n");
+		return 1;
+	}
+	ebr_domain_init(&ebr_dom, ebrs, NTS, pool_reclaim, &pool_dom);
+	tsc_init();
+	tsc_timer_start(&timer);
 	for (int i = 0; i < NTS; ++i) {
 		pthread_create(&tids[i], NULL, pthread_runner, &head);
 	}
@@ -254,10 +355,17 @@ int main(void)
 	for (int i = 0; i < NTS; ++i) {
 		pthread_join(tids[i], NULL);
 	}
-	pf_hw_timer_end(&timer, PF_TSC_FREQ_HZ_INTEL_12700K);
+	tsc_timer_end(&timer);
 
 	_integer_list_print(&head);
 
+	/* INV nodes nobody walked past are still linked and are not counted */
+	ebr_domain_stats(&ebr_dom, &reclaimed, &pending);
+	printf("Reclaimed: %lu; Pending: %lu; Slabs: %lu\n", reclaimed, pending,
+	       pool_domain_slabs(&pool_dom));
+	ebr_domain_drain(&ebr_dom);
+	pool_domain_destroy(&pool_dom);
+
 	pf_timer_pretty_time(&timer.duration, PF_HW_TIMER_US, 2, buf, 128);
 
 	printf("%s\n", buf);